@@ -0,0 +1,86 @@
+// Цена проверок типа за кадр: 100k фигур, на каждую — проверки, как у списка
+// фигур и панели правки (группа? ломаная или окружность?). Сравниваются цепочка
+// dynamic_cast (как было), сравнение тега в figureCast и переход visitFigure.
+// Сборка: cmake -DBUILD_BENCHMARKS=ON, цель DispatchBench
+#include "../src/Rectangle.hpp"
+#include "../src/Hexagon.hpp"
+#include "../src/Circle.hpp"
+#include "../src/CompositeFigure.hpp"
+#include "../src/FigureVisit.hpp"
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <vector>
+
+static const size_t FigureCount = 100000;
+static const int Frames = 50;
+
+template <typename Frame>
+static double perFrameMs(Frame&& frame, size_t& checksum) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < Frames; ++i) checksum += frame();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count() / Frames;
+}
+
+int main() {
+    // Встроенные виды вперемешку: производные от ломаной, окружности и группы
+    std::mt19937 rng(1);
+    std::vector<std::unique_ptr<AbstractFigure>> figures;
+    figures.reserve(FigureCount);
+    for (size_t i = 0; i < FigureCount; ++i) {
+        switch (rng() % 4) {
+            case 0: figures.push_back(std::make_unique<Rectangle>(1, 1, sf::Color::Red, std::vector<float>{1, 1, 1, 1})); break;
+            case 1: figures.push_back(std::make_unique<Hexagon>(1, sf::Color::Red, std::vector<float>{1, 1, 1, 1, 1, 1})); break;
+            case 2: figures.push_back(std::make_unique<Circle>(1, sf::Color::Red, 1)); break;
+            default: figures.push_back(std::make_unique<CompositeFigure>()); break;
+        }
+    }
+
+    auto dynamicFrame = [&] {
+        size_t sum = 0;
+        for (const auto& fig : figures) {
+            AbstractFigure* p = fig.get();
+            if (dynamic_cast<CompositeFigure*>(p)) sum += 1;
+            if (auto* poly = dynamic_cast<PolylineFigure*>(p)) sum += poly->getThicknesses().size();
+            else if (auto* circle = dynamic_cast<Circle*>(p)) sum += (size_t)circle->getOutlineThickness();
+        }
+        return sum;
+    };
+    auto tagFrame = [&] {
+        size_t sum = 0;
+        for (const auto& fig : figures) {
+            AbstractFigure* p = fig.get();
+            if (figureCast<CompositeFigure>(p)) sum += 1;
+            if (auto* poly = figureCast<PolylineFigure>(p)) sum += poly->getThicknesses().size();
+            else if (auto* circle = figureCast<Circle>(p)) sum += (size_t)circle->getOutlineThickness();
+        }
+        return sum;
+    };
+    struct Count {
+        size_t operator()(const PolylineFigure& poly) const { return poly.getThicknesses().size(); }
+        size_t operator()(const Circle& circle) const { return (size_t)circle.getOutlineThickness(); }
+        size_t operator()(const CompositeFigure&) const { return 1; }
+        size_t operator()(const AbstractFigure&) const { return 0; }
+    };
+    auto visitFrame = [&] {
+        size_t sum = 0;
+        for (const auto& fig : figures) sum += visitFigure(static_cast<const AbstractFigure&>(*fig), Count{});
+        return sum;
+    };
+
+    // Первый проход прогревает кэши; суммы у всех трёх способов должны совпасть
+    size_t warm = dynamicFrame() + tagFrame() + visitFrame();
+    size_t dynamicSum = 0, tagSum = 0, visitSum = 0;
+    double dynamicMs = perFrameMs(dynamicFrame, dynamicSum);
+    double tagMs = perFrameMs(tagFrame, tagSum);
+    double visitMs = perFrameMs(visitFrame, visitSum);
+    std::printf("%zu figures, %d frames\n", FigureCount, Frames);
+    std::printf("dynamic_cast:  %.3f ms/frame\n", dynamicMs);
+    std::printf("figureCast:    %.3f ms/frame\n", tagMs);
+    std::printf("visitFigure:   %.3f ms/frame\n", visitMs);
+    bool same = dynamicSum == tagSum && tagSum == visitSum && warm == 3 * dynamicSum / Frames;
+    std::printf("results %s\n", same ? "match" : "DIFFER");
+    return same ? 0 : 1;
+}
@@ -1,53 +1,198 @@
 #include "AbstractFigure.hpp"
+#include "SceneBinary.hpp"
 #include <cmath>
+#include <algorithm>
 #include <iostream>
 #include <fstream>
+#include <cstddef>
 
-AbstractFigure::AbstractFigure() : position(0,0), scaleFactor(1.f), fillColor(sf::Color::White), filled(false), pivot(0,0) {}
+AbstractFigure::AbstractFigure() : AbstractFigure(FigureKind::Other) {}
 
-void AbstractFigure::move(const sf::Vector2f& offset) { position += offset; }
-void AbstractFigure::scale(float factor) { scaleFactor *= factor; }
-void AbstractFigure::setScale(float factor) { scaleFactor = factor; }
-void AbstractFigure::setPosition(const sf::Vector2f& pos) { position = pos; }
-sf::Vector2f AbstractFigure::getPosition() const { return position; }
-float AbstractFigure::getScale() const { return scaleFactor; }
+AbstractFigure::AbstractFigure(FigureKind kind)
+    : entity(FigureStore::instance().create(this)), kind(kind), pivot(0,0) {}
 
-void AbstractFigure::setFillColor(sf::Color color) { fillColor = color; }
-sf::Color AbstractFigure::getFillColor() const { return fillColor; }
-void AbstractFigure::setFilled(bool f) { filled = f; }
-bool AbstractFigure::isFilled() const { return filled; }
+AbstractFigure::~AbstractFigure() { FigureStore::instance().destroy(entity); }
+
+// Перед объектом храним ресурс, из которого он выделен: пул мог смениться до удаления
+static constexpr size_t ArenaHeader = alignof(std::max_align_t);
+
+void* AbstractFigure::operator new(size_t size) {
+    std::pmr::memory_resource* resource = FigureArena::currentResource();
+    void* block = resource->allocate(size + ArenaHeader, alignof(std::max_align_t));
+    *static_cast<std::pmr::memory_resource**>(block) = resource;
+    return static_cast<char*>(block) + ArenaHeader;
+}
+
+void AbstractFigure::operator delete(void* p, size_t size) {
+    if (!p) return;
+    void* block = static_cast<char*>(p) - ArenaHeader;
+    std::pmr::memory_resource* resource = *static_cast<std::pmr::memory_resource**>(block);
+    resource->deallocate(block, size + ArenaHeader, alignof(std::max_align_t));
+}
+
+void AbstractFigure::move(const sf::Vector2f& offset) { setPosition(getPosition() + offset); }
+void AbstractFigure::scale(float factor) { setScale(getScaleXY() * factor); }
+void AbstractFigure::setScale(float factor) { setScale({factor, factor}); }
+void AbstractFigure::setScale(const sf::Vector2f& factors) { FigureStore::instance().setScale(entity, factors); invalidateBounds(); }
+void AbstractFigure::setPosition(const sf::Vector2f& pos) { FigureStore::instance().setPosition(entity, pos); }
+sf::Vector2f AbstractFigure::getPosition() const { return FigureStore::instance().position(entity); }
+float AbstractFigure::getScale() const { return FigureStore::instance().scale(entity).x; }
+sf::Vector2f AbstractFigure::getScaleXY() const { return FigureStore::instance().scale(entity); }
+
+void AbstractFigure::rotate(float degrees) { setRotation(std::fmod(getRotation() + degrees, 360.f)); }
+void AbstractFigure::setRotation(float degrees) { FigureStore::instance().setRotation(entity, degrees); invalidateBounds(); }
+float AbstractFigure::getRotation() const { return FigureStore::instance().rotation(entity); }
+
+// world(v) = origin + s*pivot + R(s*(v - pivot)); без поворота это прежнее origin + s*v
+sf::Transform AbstractFigure::getLocalTransform() const {
+    FigureStore& store = FigureStore::instance();
+    sf::Vector2f s = store.scale(entity);
+    sf::Vector2f origin = parent ? slot : store.position(entity);
+    sf::Transform t;
+    t.translate(origin.x + s.x * pivot.x, origin.y + s.y * pivot.y);
+    t.rotate(store.rotation(entity));
+    t.scale(s);
+    t.translate(-pivot);
+    return t;
+}
+
+bool AbstractFigure::worldCached() const {
+    const FigureStore& store = FigureStore::instance();
+    if (!parent) return store.worldValid(entity, 0);
+    return store.worldValid(entity, store.worldStamp(parent->entity)) && parent->worldCached();
+}
+
+// Читает кэш, но не пишет его: обход сцены может идти из нескольких потоков
+sf::Transform AbstractFigure::getWorldTransform() const {
+    if (worldCached()) return FigureStore::instance().world(entity);
+    sf::Transform t = getLocalTransform();
+    return parent ? parent->getWorldTransform() * t : t;
+}
+
+// Матрица группы обновляется первой: её пересчёт даёт новую метку,
+// и вложенные фигуры пересчитают свои матрицы при следующем обновлении
+void AbstractFigure::refreshWorld() {
+    FigureStore& store = FigureStore::instance();
+    uint64_t parentStamp = 0;
+    if (parent) {
+        if (!parent->worldCached()) parent->AbstractFigure::refreshWorld();
+        parentStamp = store.worldStamp(parent->entity);
+    }
+    if (!store.worldValid(entity, parentStamp)) {
+        sf::Transform t = getLocalTransform();
+        if (parent) t = store.world(parent->entity) * t;
+        store.setWorld(entity, t, parentStamp);
+    }
+}
+
+sf::Vector2f AbstractFigure::axisScales(const sf::Transform& t) {
+    const float* m = t.getMatrix();
+    return {std::hypot(m[0], m[1]), std::hypot(m[4], m[5])};
+}
+
+// Меньшее сингулярное число линейной части: у поворота со сдвигом из вложенных
+// групп оно бывает меньше длин обеих осей
+float AbstractFigure::minStretch(const sf::Transform& t) {
+    const float* m = t.getMatrix();
+    float e = (m[0] + m[5]) / 2, f = (m[0] - m[5]) / 2;
+    float g = (m[1] + m[4]) / 2, h = (m[1] - m[4]) / 2;
+    return std::abs(std::hypot(e, h) - std::hypot(f, g));
+}
+
+void AbstractFigure::setParent(AbstractFigure* p, const sf::Vector2f& s) {
+    parent = p;
+    slot = s;
+    FigureStore::instance().invalidateTransform(entity);
+}
+
+void AbstractFigure::setTypeName(std::string_view name) {
+    FigureStore::instance().setTypeName(entity, SymbolTable::instance().intern(name));
+}
+
+std::string_view AbstractFigure::getTypeName() const {
+    return SymbolTable::instance().name(FigureStore::instance().typeName(entity));
+}
+
+void AbstractFigure::setCustomName(std::string_view name) {
+    FigureStore::instance().setCustomName(entity, SymbolTable::instance().intern(name));
+}
+
+std::string_view AbstractFigure::getCustomName() const {
+    Symbol custom = FigureStore::instance().customName(entity);
+    return custom ? SymbolTable::instance().name(custom) : getTypeName();
+}
+
+void AbstractFigure::setFillColor(sf::Color color) { FigureStore::instance().setFillColor(entity, color); invalidateStyle(); }
+sf::Color AbstractFigure::getFillColor() const { return FigureStore::instance().fillColor(entity); }
+void AbstractFigure::setFilled(bool f) { FigureStore::instance().setFilled(entity, f); invalidateStyle(); }
+bool AbstractFigure::isFilled() const { return FigureStore::instance().filled(entity); }
 
 size_t AbstractFigure::getVertexCount() const { return vertices.size(); }
 sf::Vector2f AbstractFigure::getLocalVertex(size_t index) const { return vertices[index]; }
-sf::Vector2f AbstractFigure::getGlobalVertex(size_t index) const { return position + vertices[index] * scaleFactor; }
-void AbstractFigure::setLocalVertex(size_t index, const sf::Vector2f& pos) { vertices[index] = pos; }
+sf::Vector2f AbstractFigure::getGlobalVertex(size_t index) const { return getWorldTransform().transformPoint(vertices[index]); }
+void AbstractFigure::setLocalVertex(size_t index, const sf::Vector2f& pos) {
+    vertices.set(index, pos);
+    onVerticesChanged();
+    invalidateBounds();
+}
 
-void AbstractFigure::addVertex(const sf::Vector2f& pos) { vertices.push_back(pos); }
-void AbstractFigure::removeVertex(size_t index) { if (index < vertices.size()) vertices.erase(vertices.begin() + index); }
+void AbstractFigure::setVertices(const PooledArray<sf::Vector2f>& values) {
+    vertices = values;
+    onVerticesChanged();
+    invalidateBounds();
+}
+
+void AbstractFigure::addVertex(const sf::Vector2f& pos) {
+    vertices.push_back(pos);
+    onVerticesChanged();
+    invalidateBounds();
+}
+
+void AbstractFigure::removeVertex(size_t index) {
+    if (index < vertices.size()) {
+        vertices.erase(index);
+        onVerticesChanged();
+        invalidateBounds();
+    }
+}
+
+void AbstractFigure::insertVertex(size_t index, const sf::Vector2f& pos) {
+    index = std::min(index, vertices.size());
+    vertices.insert(index, pos);
+    onVerticesChanged();
+    invalidateBounds();
+}
 
 sf::Vector2f AbstractFigure::getLocalPivot() const { return pivot; }
-sf::Vector2f AbstractFigure::getGlobalPivot() const { return position + pivot * scaleFactor; }
-void AbstractFigure::setLocalPivot(const sf::Vector2f& p) { pivot = p; }
-void AbstractFigure::movePivot(const sf::Vector2f& delta) { pivot += delta; }
-
-void AbstractFigure::serialize(std::ostream& out) const {
-    // Используем виртуальную функцию, так как поле typeName пустое
-    out << getTypeName() << '\n'; 
-    out << getCustomName() << "\n";
-    out << position.x << ' ' << position.y << ' '
-        << scaleFactor << ' '
-        << (int)fillColor.r << ' ' << (int)fillColor.g << ' ' << (int)fillColor.b << ' '
-        << filled << ' '
-        << pivot.x << ' ' << pivot.y << '\n';
-}
-
-void AbstractFigure::deserialize(std::istream& in) {
-    int r, g, b;
-    in >> customName;
-    in >> position.x >> position.y
-       >> scaleFactor
-       >> r >> g >> b
-       >> filled
-       >> pivot.x >> pivot.y;
-    fillColor = sf::Color(r, g, b);
+sf::Vector2f AbstractFigure::getGlobalPivot() const { return getWorldTransform().transformPoint(pivot); }
+// При повороте пивот — центр вращения, поэтому его перенос сдвигает фигуру
+void AbstractFigure::setLocalPivot(const sf::Vector2f& p) {
+    pivot = p;
+    FigureStore::instance().invalidateTransform(entity);
+    invalidateBounds();
+}
+void AbstractFigure::movePivot(const sf::Vector2f& delta) { setLocalPivot(pivot + delta); }
+
+// Позиция фигуры на локальные границы не влияет, поэтому setPosition/move сюда не ходят
+void AbstractFigure::invalidateBounds() {
+    FigureStore::instance().invalidateBounds(entity);
+    if (parent) parent->onChildBoundsChanged();
+}
+
+void AbstractFigure::readBinary(SceneReader& in) {
+    std::string_view customName = in.str();
+    sf::Vector2f position = in.vec();
+    sf::Vector2f scaleXY = in.vec();
+    float rotation = in.f32();
+    pivot = in.vec();
+    sf::Color fill = in.color();
+    bool filled = in.u8() != 0;
+    FigureStore& store = FigureStore::instance();
+    store.setCustomName(entity, SymbolTable::instance().intern(customName));
+    store.setPosition(entity, position);
+    store.setScale(entity, scaleXY);
+    store.setRotation(entity, rotation);
+    store.setFillColor(entity, fill);
+    store.setFilled(entity, filled);
+    invalidateBounds();
 }
\ No newline at end of file
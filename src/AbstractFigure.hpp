@@ -3,23 +3,69 @@
 #include <vector>
 #include <memory>
 #include <fstream>
+#include <cstdint>
+#include "FigureArena.hpp"
+#include "FigureStore.hpp"
+#include "GeometryPool.hpp"
+
+// Вид встроенной фигуры: проверка типа — сравнение байта вместо dynamic_cast.
+// Производные от PolylineFigure (Rectangle, Triangle, ...) имеют вид Polyline
+enum class FigureKind : uint8_t { Other, Polyline, Circle, Composite };
+
+class SceneReader;
 
 class AbstractFigure {
 public:
     AbstractFigure();
-    virtual ~AbstractFigure() = default;
+    AbstractFigure(const AbstractFigure&) = delete;
+    AbstractFigure& operator=(const AbstractFigure&) = delete;
+    virtual ~AbstractFigure();
 
-    virtual void draw(sf::RenderWindow& window) const = 0;
+    // Память под фигуры берётся из текущего пула сцены (FigureArena)
+    static void* operator new(size_t size);
+    static void operator delete(void* p, size_t size);
+
+    // Рисует фигуру под преобразованием групп над ней; сама фигура не меняется
+    virtual void draw(sf::RenderTarget& target, const sf::Transform& parent) const = 0;
+    void draw(sf::RenderTarget& target) const { draw(target, sf::Transform::Identity); }
     virtual bool contains(const sf::Vector2f& point) const = 0;
+    // Попадание точки сцены в фигуру, нарисованную под преобразованием parent
+    bool hitTest(const sf::Vector2f& point, const sf::Transform& parent) const {
+        return contains(parent.getInverse().transformPoint(point));
+    }
+    // Рамка в координатах сцены
     virtual sf::FloatRect getBoundingBox() const = 0;
+    // Рамка геометрии, переведённой из локальных координат фигуры преобразованием t
+    virtual sf::FloatRect getBoundsUnder(const sf::Transform& t) const = 0;
+    // Дописывает в out (sf::Triangles) треугольники фигуры, переведённой преобразованием t.
+    // worldScale — пикселей сцены на единицу системы t: толщины линий заданы в пикселях
+    virtual void tessellate(const sf::Transform& /*t*/, float /*worldScale*/, sf::VertexArray& /*out*/) const {}
     virtual std::unique_ptr<AbstractFigure> clone() const = 0;
 
     void move(const sf::Vector2f& offset);
     void scale(float factor);
     void setScale(float factor);
+    void setScale(const sf::Vector2f& factors);
     void setPosition(const sf::Vector2f& pos);
     sf::Vector2f getPosition() const;
+    // Масштаб по X; для равномерного масштаба — просто масштаб
     float getScale() const;
+    sf::Vector2f getScaleXY() const;
+    // Поворот в градусах по часовой стрелке вокруг пивота
+    void rotate(float degrees);
+    void setRotation(float degrees);
+    float getRotation() const;
+
+    // Локальные координаты -> система группы-владельца (для фигур верхнего уровня — сцена):
+    // поворот и масштаб вокруг пивота, затем перенос на позицию или место в группе
+    sf::Transform getLocalTransform() const;
+    // Локальные координаты -> сцена. Кэш в FigureStore только читается: если он
+    // устарел, матрица собирается заново из локальных матриц групп над фигурой
+    sf::Transform getWorldTransform() const;
+    // Обновляет кэши мировых координат фигуры, у группы — и всех потомков.
+    // Только из одного потока; после этого draw, contains и рамки фигуры
+    // ничего не пишут, пока её не изменят
+    virtual void refreshWorld();
 
     void setFillColor(sf::Color color);
     sf::Color getFillColor() const;
@@ -32,31 +78,73 @@ public:
     void setLocalVertex(size_t index, const sf::Vector2f& pos);
     virtual void addVertex(const sf::Vector2f& pos);
     virtual void removeVertex(size_t index);
+    virtual void insertVertex(size_t index, const sf::Vector2f& pos);
+    // Весь массив вершин разом; копия разделяет блок пула до первой записи
+    const PooledArray<sf::Vector2f>& getVertices() const { return vertices; }
+    void setVertices(const PooledArray<sf::Vector2f>& values);
 
     sf::Vector2f getLocalPivot() const;
     sf::Vector2f getGlobalPivot() const;
     void setLocalPivot(const sf::Vector2f& p);
     void movePivot(const sf::Vector2f& delta);
 
-    void setTypeName(const std::string& name) { typeName = name; }
-    std::string getTypeName() const { return typeName; }
+    void setTypeName(std::string_view name);
+    std::string_view getTypeName() const;
 
-    void setCustomName(const std::string& name) { customName = name; }
-    std::string getCustomName() const { 
-        return customName.empty() ? getTypeName() : customName; 
-    }
-    
-    virtual void serialize(std::ostream& out) const = 0;
-    virtual void deserialize(std::istream& in);
+    void setCustomName(std::string_view name);
+    std::string_view getCustomName() const;
+
+    // Номер записи фигуры в FigureStore
+    EntityId getEntity() const { return entity; }
+    FigureKind getKind() const { return kind; }
+
+    // Запись двоичного формата после вида и номера типа (см. SceneBinary.hpp).
+    // Текстовый формат читается через него же (SceneText.hpp)
+    virtual void readBinary(SceneReader& in);
+
+    // Группа-владелец (nullptr для фигур верхнего уровня) и место в ней.
+    // Вложенная фигура рисуется на месте slot, собственная позиция не используется
+    AbstractFigure* getParent() const { return parent; }
+    void setParent(AbstractFigure* p, const sf::Vector2f& slot = {});
 
 
 protected:
-    sf::Vector2f position;
-    float scaleFactor;
-    sf::Color fillColor;
-    bool filled;
-    std::vector<sf::Vector2f> vertices;
+    explicit AbstractFigure(FigureKind kind);
+
+    // Сообщает группе-владельцу, что локальные границы фигуры изменились
+    void invalidateBounds();
+    virtual void onChildBoundsChanged() {}
+    // То же для цвета и заливки: границы не меняются, но меняется вид группы
+    void invalidateStyle() {
+        FigureStore::instance().markChanged(entity);
+        if (parent) parent->onChildStyleChanged();
+    }
+    virtual void onChildStyleChanged() { invalidateStyle(); }
+    // Вызывается после любого изменения списка или координат вершин
+    virtual void onVerticesChanged() {}
+    // Во сколько раз t растягивает отрезки вдоль локальных осей X и Y
+    static sf::Vector2f axisScales(const sf::Transform& t);
+    // Наименьшее растяжение t по всем направлениям: отрезок длины d после t не короче d * minStretch
+    static float minStretch(const sf::Transform& t);
+    // Верна ли кэшированная мировая матрица фигуры и всех групп над ней
+    bool worldCached() const;
+
+    // Позиция, масштаб, стиль и имена лежат в FigureStore под этим номером
+    EntityId entity;
+    const FigureKind kind;
+    PooledArray<sf::Vector2f> vertices;
     sf::Vector2f pivot;
-    std::string typeName = "Figure";
-    std::string customName;
-};
\ No newline at end of file
+    AbstractFigure* parent = nullptr;
+    sf::Vector2f slot;
+};
+
+// Приведение по тегу вида; T — PolylineFigure, Circle или CompositeFigure
+template <typename T>
+T* figureCast(AbstractFigure* fig) {
+    return fig && fig->getKind() == T::Kind ? static_cast<T*>(fig) : nullptr;
+}
+
+template <typename T>
+const T* figureCast(const AbstractFigure* fig) {
+    return fig && fig->getKind() == T::Kind ? static_cast<const T*>(fig) : nullptr;
+}
@@ -0,0 +1,153 @@
+#include "BatchOps.hpp"
+#include "FigureVisit.hpp"
+#include <thread>
+#include <algorithm>
+
+// Меньше этого поток дороже самой работы
+static constexpr size_t ParallelThreshold = 32768;
+
+// Делит [0, count) между потоками; fn(first, n) обрабатывает свой кусок
+template <typename Fn>
+static void parallelFor(size_t count, Fn fn) {
+    size_t workers = std::max(1u, std::thread::hardware_concurrency());
+    if (count < ParallelThreshold || workers == 1) {
+        fn(0, count);
+        return;
+    }
+    workers = std::min(workers, count / (ParallelThreshold / 4));
+    size_t chunk = (count + workers - 1) / workers;
+    std::vector<std::thread> threads;
+    for (size_t first = chunk; first < count; first += chunk)
+        threads.emplace_back(fn, first, std::min(chunk, count - first));
+    fn(0, std::min(chunk, count));
+    for (auto& t : threads) t.join();
+}
+
+// Фигуры верхнего уровня — номерами в хранилище, вложенные — отдельно
+static void split(const std::vector<AbstractFigure*>& figs, std::vector<EntityId>& top,
+                  std::vector<AbstractFigure*>& nested) {
+    top.reserve(figs.size());
+    for (AbstractFigure* fig : figs) {
+        if (fig->getParent()) nested.push_back(fig);
+        else top.push_back(fig->getEntity());
+    }
+}
+
+namespace BatchOps {
+
+void translate(const std::vector<AbstractFigure*>& figs, sf::Vector2f offset) {
+    std::vector<EntityId> top;
+    std::vector<AbstractFigure*> nested;
+    split(figs, top, nested);
+    FigureStore& store = FigureStore::instance();
+    parallelFor(top.size(), [&](size_t first, size_t n) { store.translate(top.data() + first, n, offset); });
+    store.markChanged(top.data(), top.size());
+    for (AbstractFigure* fig : nested) fig->move(offset);
+}
+
+void scale(const std::vector<AbstractFigure*>& figs, float factor) {
+    if (figs.empty()) return;
+    std::vector<EntityId> top;
+    std::vector<AbstractFigure*> nested;
+    split(figs, top, nested);
+    FigureStore& store = FigureStore::instance();
+    sf::FloatRect box = nested.empty() ? store.unionBounds(top.data(), top.size()) : bounds(figs);
+    sf::Vector2f pivot(box.left + box.width / 2, box.top + box.height / 2);
+    parallelFor(top.size(), [&](size_t first, size_t n) { store.scaleAbout(top.data() + first, n, pivot, factor); });
+    store.markChanged(top.data(), top.size());
+    for (AbstractFigure* fig : nested) {
+        fig->setPosition(pivot + (fig->getPosition() - pivot) * factor);
+        fig->scale(factor);
+    }
+}
+
+void rotate(const std::vector<AbstractFigure*>& figs, float degrees) {
+    std::vector<EntityId> top;
+    std::vector<AbstractFigure*> nested;
+    split(figs, top, nested);
+    FigureStore& store = FigureStore::instance();
+    parallelFor(top.size(), [&](size_t first, size_t n) { store.rotate(top.data() + first, n, degrees); });
+    store.markChanged(top.data(), top.size());
+    for (AbstractFigure* fig : nested) fig->rotate(degrees);
+}
+
+void setFill(const std::vector<AbstractFigure*>& figs, sf::Color color, bool filled) {
+    std::vector<EntityId> top;
+    std::vector<AbstractFigure*> nested;
+    split(figs, top, nested);
+    FigureStore& store = FigureStore::instance();
+    parallelFor(top.size(), [&](size_t first, size_t n) { store.setFill(top.data() + first, n, color, filled); });
+    store.markChanged(top.data(), top.size());
+    // Замороженная группа должна узнать о новом цвете потомка
+    for (AbstractFigure* fig : nested) {
+        fig->setFillColor(color);
+        fig->setFilled(filled);
+    }
+}
+
+// Стороны лежат в общем пуле геометрии, который правится только из одного потока
+void setSideColor(const std::vector<AbstractFigure*>& figs, sf::Color color) {
+    struct Apply {
+        sf::Color color;
+        void operator()(PolylineFigure& poly) const { poly.setAllSideColors(color); }
+        void operator()(Circle& circle) const { circle.setOutlineColor(color); }
+        void operator()(AbstractFigure&) const {}
+    };
+    for (AbstractFigure* fig : figs) visitFigure(*fig, Apply{color});
+}
+
+void setThickness(const std::vector<AbstractFigure*>& figs, float thickness) {
+    struct Apply {
+        float thickness;
+        void operator()(PolylineFigure& poly) const { poly.setAllThicknesses(thickness); }
+        void operator()(Circle& circle) const { circle.setOutlineThickness(thickness); }
+        void operator()(AbstractFigure&) const {}
+    };
+    for (AbstractFigure* fig : figs) visitFigure(*fig, Apply{thickness});
+}
+
+// Рамки в хранилище отсчитываются от собственной позиции фигуры, а вложенная
+// фигура стоит на месте в группе, поэтому её рамку берём по мировой матрице
+static sf::FloatRect frameOf(AbstractFigure* fig) {
+    return fig->getParent() ? fig->getBoundingBox() : FigureStore::instance().bounds(fig->getEntity());
+}
+
+sf::FloatRect bounds(const std::vector<AbstractFigure*>& figs) {
+    std::vector<EntityId> top;
+    std::vector<AbstractFigure*> nested;
+    split(figs, top, nested);
+    sf::FloatRect box = FigureStore::instance().unionBounds(top.data(), top.size());
+    bool empty = top.empty();
+    for (AbstractFigure* fig : nested) {
+        sf::FloatRect r = fig->getBoundingBox();
+        if (empty) {
+            box = r;
+            empty = false;
+            continue;
+        }
+        float right = std::max(box.left + box.width, r.left + r.width);
+        float bottom = std::max(box.top + box.height, r.top + r.height);
+        box.left = std::min(box.left, r.left);
+        box.top = std::min(box.top, r.top);
+        box.width = right - box.left;
+        box.height = bottom - box.top;
+    }
+    return box;
+}
+
+static void addFrame(sf::VertexArray& lines, const sf::FloatRect& r, sf::Color color) {
+    sf::Vector2f a(r.left, r.top), b(r.left + r.width, r.top);
+    sf::Vector2f c(r.left + r.width, r.top + r.height), d(r.left, r.top + r.height);
+    sf::Vector2f corners[8] = {a, b, b, c, c, d, d, a};
+    for (const auto& p : corners) lines.append(sf::Vertex(p, color));
+}
+
+void buildFrames(const std::vector<AbstractFigure*>& figs, sf::VertexArray& lines) {
+    lines.clear();
+    lines.setPrimitiveType(sf::Lines);
+    if (figs.empty()) return;
+    for (AbstractFigure* fig : figs) addFrame(lines, frameOf(fig), sf::Color::Red);
+    if (figs.size() > 1) addFrame(lines, bounds(figs), sf::Color::Yellow);
+}
+
+}
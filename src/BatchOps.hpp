@@ -0,0 +1,24 @@
+#pragma once
+#include "AbstractFigure.hpp"
+#include <vector>
+
+// Групповые операции над выделением: одна правка на весь набор за один проход.
+// Трансформ и заливка фигур верхнего уровня меняются прямо в массивах FigureStore,
+// большие наборы делятся между потоками. Вложенные фигуры идут через обычные методы,
+// потому что их изменения поднимаются по цепочке групп.
+namespace BatchOps {
+    void translate(const std::vector<AbstractFigure*>& figs, sf::Vector2f offset);
+    // Масштаб относительно центра общей рамки набора
+    void scale(const std::vector<AbstractFigure*>& figs, float factor);
+    // Поворот каждой фигуры вокруг её собственного пивота
+    void rotate(const std::vector<AbstractFigure*>& figs, float degrees);
+    void setFill(const std::vector<AbstractFigure*>& figs, sf::Color color, bool filled);
+    // Цвет и толщина всех сторон (для кругов — контура)
+    void setSideColor(const std::vector<AbstractFigure*>& figs, sf::Color color);
+    void setThickness(const std::vector<AbstractFigure*>& figs, float thickness);
+
+    // Общая рамка набора
+    sf::FloatRect bounds(const std::vector<AbstractFigure*>& figs);
+    // Рамки всех фигур набора и общая рамка одним массивом линий
+    void buildFrames(const std::vector<AbstractFigure*>& figs, sf::VertexArray& lines);
+}
@@ -0,0 +1,170 @@
+#pragma once
+#include <SFML/Graphics/Color.hpp>
+#include <SFML/System/Vector2.hpp>
+#include <string>
+#include <string_view>
+#include <cstring>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+
+// Числа в двоичных файлах хранятся в little-endian; на такой машине массивы
+// копируются как есть, иначе байты каждого элемента переставляются
+namespace ByteOrder {
+    constexpr bool Little = __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__;
+
+    inline void swap(char* p, size_t width) {
+        for (size_t i = 0; i < width / 2; ++i) std::swap(p[i], p[width - 1 - i]);
+    }
+
+    // width — размер числа внутри элемента (у sf::Vector2f это float, у цвета — байт)
+    inline void copy(void* dst, const void* src, size_t bytes, size_t width) {
+        std::memcpy(dst, src, bytes);
+        if (!Little && width > 1) {
+            for (size_t i = 0; i < bytes; i += width) swap(static_cast<char*>(dst) + i, width);
+        }
+    }
+}
+
+static_assert(sizeof(sf::Color) == 4 && sizeof(sf::Vector2f) == 8, "packed layout expected");
+
+// Дописывает данные в конец строки-буфера
+class ByteWriter {
+public:
+    explicit ByteWriter(std::string& out) : out(out) {}
+
+    void u8(uint8_t v) { out.push_back(char(v)); }
+    void u32(uint32_t v) { put(&v, sizeof v, sizeof v); }
+    void u64(uint64_t v) { put(&v, sizeof v, sizeof v); }
+    void f32(float v) { put(&v, sizeof v, sizeof v); }
+    void vec(sf::Vector2f v) { put(&v, sizeof v, sizeof(float)); }
+    void color(sf::Color c) { put(&c, sizeof c, 1); }
+    // Строка с длиной впереди: пробелы и переводы строк внутри допустимы
+    void str(std::string_view s) {
+        u32(uint32_t(s.size()));
+        out.append(s.data(), s.size());
+    }
+    template <typename T>
+    void array(const T* values, size_t n, size_t width) { put(values, n * sizeof(T), width); }
+
+    // Место под длину записи; endFrame вписывает число байт, записанных после него
+    size_t beginFrame() {
+        u32(0);
+        return out.size();
+    }
+    void endFrame(size_t start) { patch(start - sizeof(uint32_t), uint32_t(out.size() - start), sizeof(uint32_t)); }
+    // Переписывает уже записанное значение по позиции at в буфере (до flush)
+    template <typename T>
+    void patch(size_t at, T value, size_t width) { ByteOrder::copy(&out[at], &value, sizeof value, width); }
+
+    // Нули до смещения от начала файла, кратного alignment
+    void align(size_t alignment) {
+        size_t pad = (alignment - offset() % alignment) % alignment;
+        out.append(pad, '\0');
+    }
+
+    size_t size() const { return out.size(); }
+    // Смещение от начала файла с учётом уже отправленных в поток байт
+    size_t offset() const { return flushed + out.size(); }
+    // Отправляет накопленное в поток и очищает буфер
+    template <typename Stream>
+    void flush(Stream& stream) {
+        stream.write(out.data(), out.size());
+        flushed += out.size();
+        out.clear();
+    }
+
+private:
+    void put(const void* p, size_t bytes, size_t width) {
+        size_t at = out.size();
+        out.resize(at + bytes);
+        ByteOrder::copy(&out[at], p, bytes, width);
+    }
+
+    std::string& out;
+    size_t flushed = 0;
+};
+
+// Чтение из непрерывного буфера. Выход за конец не читает чужую память:
+// чтение возвращает нули, а ok() становится false
+class ByteReader {
+public:
+    ByteReader(const char* data, size_t size) : begin(data), pos(data), end(data + size) {}
+
+    bool ok() const { return good; }
+    const char* data() const { return begin; }
+    size_t size() const { return size_t(end - begin); }
+    size_t remaining() const { return size_t(end - pos); }
+    const char* position() const { return pos; }
+    void seek(const char* p) {
+        if (p > end) fail();
+        else pos = p;
+    }
+
+    // Пропускает выравнивание, записанное ByteWriter::align
+    void align(size_t alignment) {
+        size_t pad = (alignment - size_t(pos - begin) % alignment) % alignment;
+        if (pad > remaining()) fail();
+        else pos += pad;
+    }
+
+    uint8_t u8() { uint8_t v = 0; get(&v, sizeof v, 1); return v; }
+    uint32_t u32() { uint32_t v = 0; get(&v, sizeof v, sizeof v); return v; }
+    uint64_t u64() { uint64_t v = 0; get(&v, sizeof v, sizeof v); return v; }
+    float f32() { float v = 0.f; get(&v, sizeof v, sizeof v); return v; }
+    sf::Vector2f vec() { sf::Vector2f v; get(&v, sizeof v, sizeof(float)); return v; }
+    sf::Color color() { sf::Color c(0, 0, 0, 0); get(&c, sizeof c, 1); return c; }
+    // Указывает внутрь буфера: действительна, пока жив буфер
+    std::string_view str() {
+        uint32_t n = u32();
+        if (n > remaining()) {
+            fail();
+            return {};
+        }
+        std::string_view s(pos, n);
+        pos += n;
+        return s;
+    }
+    template <typename T>
+    void array(T* values, size_t n, size_t width) { get(values, n * sizeof(T), width); }
+    // Массив прямо в буфере, без копирования; nullptr — не уместился
+    template <typename T>
+    const T* view(size_t n) {
+        if (n > remaining() / sizeof(T)) {
+            fail();
+            return nullptr;
+        }
+        const T* values = reinterpret_cast<const T*>(pos);
+        pos += n * sizeof(T);
+        return values;
+    }
+    // Число элементов по elementBytes байт; если столько не уместится в остатке — ошибка
+    uint32_t count(size_t elementBytes) {
+        uint32_t n = u32();
+        if (n > remaining() / elementBytes) {
+            fail();
+            return 0;
+        }
+        return n;
+    }
+
+    void fail() {
+        good = false;
+        pos = end;
+    }
+
+private:
+    void get(void* p, size_t bytes, size_t width) {
+        if (bytes > remaining()) {
+            fail();
+            return;
+        }
+        ByteOrder::copy(p, pos, bytes, width);
+        pos += bytes;
+    }
+
+    const char* begin;
+    const char* pos;
+    const char* end;
+    bool good = true;
+};
@@ -1,54 +1,109 @@
 #include "Circle.hpp"
+#include "SceneBinary.hpp"
 #include <cmath>
 
 
 Circle::Circle(float radius, const sf::Color& color, float thickness)
-    : baseRadius(radius), outlineColor(color), outlineThickness(thickness) {}
-
-void Circle::draw(sf::RenderWindow& window) const {
-    float r = baseRadius * scaleFactor;
-    int pointCount = static_cast<int>(r * 5);
-    sf::CircleShape circle(r, pointCount);
-    circle.setOrigin(r, r);
-    circle.setPosition(position);
-    circle.setFillColor(filled ? fillColor : sf::Color::Transparent);
+    : AbstractFigure(Kind), baseRadius(radius), outlineColor(color), outlineThickness(thickness) {}
+
+// Круг строится в локальных координатах (центр в нуле) и рисуется под мировой матрицей.
+// Обводка задаётся в пикселях сцены, поэтому делится на масштаб
+void Circle::draw(sf::RenderTarget& target, const sf::Transform& parent) const {
+    const sf::Transform& world = getWorldTransform();
+    sf::Vector2f s = axisScales(world);
+    float scaleFactor = std::max(s.x, s.y);
+    if (scaleFactor <= 0) return;
+    int pointCount = static_cast<int>(baseRadius * scaleFactor * 5);
+    sf::CircleShape circle(baseRadius, pointCount);
+    circle.setOrigin(baseRadius, baseRadius);
+    circle.setFillColor(isFilled() ? getFillColor() : sf::Color::Transparent);
     circle.setOutlineColor(outlineColor);
-    circle.setOutlineThickness(outlineThickness);
-    window.draw(circle);
+    circle.setOutlineThickness(outlineThickness / scaleFactor);
+    target.draw(circle, parent * world);
 }
 
 bool Circle::contains(const sf::Vector2f& point) const {
-    float r = baseRadius * scaleFactor + outlineThickness * 0.5f;
-    float dx = point.x - position.x;
-    float dy = point.y - position.y;
-    return dx*dx + dy*dy <= r*r;
+    const sf::Transform& world = getWorldTransform();
+    sf::Vector2f s = axisScales(world);
+    float scaleFactor = std::max(s.x, s.y);
+    if (scaleFactor <= 0) return false;
+    sf::Vector2f local = world.getInverse().transformPoint(point);
+    float r = baseRadius + outlineThickness * 0.5f / scaleFactor;
+    return local.x*local.x + local.y*local.y <= r*r;
+}
+
+float Circle::getWorldRadius() const {
+    sf::Vector2f s = axisScales(getWorldTransform());
+    return baseRadius * std::max(s.x, s.y);
 }
 
 sf::FloatRect Circle::getBoundingBox() const {
-    float r = baseRadius * scaleFactor + outlineThickness;
-    return sf::FloatRect(position.x - r, position.y - r, 2*r, 2*r);
+    return getBoundsUnder(getWorldTransform());
+}
+
+// Полуоси рамки эллипса — длины строк линейной части матрицы, умноженные на радиус
+sf::FloatRect Circle::getBoundsUnder(const sf::Transform& t) const {
+    const float* m = t.getMatrix();
+    sf::Vector2f center = t.transformPoint(0, 0);
+    float rx = baseRadius * std::hypot(m[0], m[4]) + outlineThickness;
+    float ry = baseRadius * std::hypot(m[1], m[5]) + outlineThickness;
+    return sf::FloatRect(center.x - rx, center.y - ry, 2*rx, 2*ry);
+}
+
+// Те же точки, что у sf::CircleShape в draw: веер заливки и кольцо обводки снаружи радиуса
+void Circle::tessellate(const sf::Transform& t, float worldScale, sf::VertexArray& out) const {
+    sf::Vector2f s = axisScales(t);
+    float scaleFactor = std::max(s.x, s.y) * worldScale;
+    if (scaleFactor <= 0) return;
+    size_t pointCount = static_cast<size_t>(baseRadius * scaleFactor * 5);
+    if (pointCount < 3) return;
+    float outer = baseRadius + outlineThickness / scaleFactor;
+    sf::Vector2f center = t.transformPoint(0, 0);
+    sf::Color fill = getFillColor();
+    bool filled = isFilled();
+    const float step = 2 * 3.14159265f / pointCount;
+    // Первая точка сверху, как у SFML
+    sf::Vector2f dir(0, -1);
+    sf::Vector2f inner = t.transformPoint(dir * baseRadius);
+    sf::Vector2f outerPoint = t.transformPoint(dir * outer);
+    for (size_t i = 1; i <= pointCount; ++i) {
+        float angle = i * step - 3.14159265f / 2;
+        sf::Vector2f nextDir(std::cos(angle), std::sin(angle));
+        sf::Vector2f nextIn = t.transformPoint(nextDir * baseRadius);
+        sf::Vector2f nextOut = t.transformPoint(nextDir * outer);
+        if (filled) {
+            out.append({center, fill});
+            out.append({inner, fill});
+            out.append({nextIn, fill});
+        }
+        if (outlineThickness > 0) {
+            out.append({inner, outlineColor});
+            out.append({outerPoint, outlineColor});
+            out.append({nextOut, outlineColor});
+            out.append({inner, outlineColor});
+            out.append({nextOut, outlineColor});
+            out.append({nextIn, outlineColor});
+        }
+        inner = nextIn;
+        outerPoint = nextOut;
+    }
 }
 
 std::unique_ptr<AbstractFigure> Circle::clone() const {
     auto copy = std::make_unique<Circle>(baseRadius, outlineColor, outlineThickness);
-    copy->setPosition(position);
-    copy->setScale(scaleFactor);
-    copy->setFillColor(fillColor);
-    copy->setFilled(filled);
+    copy->setPosition(getPosition());
+    copy->setScale(getScaleXY());
+    copy->setRotation(getRotation());
+    copy->setFillColor(getFillColor());
+    copy->setFilled(isFilled());
     copy->setLocalPivot(pivot);
     return copy;
 }
 
-void Circle::serialize(std::ostream& out) const {
-    AbstractFigure::serialize(out);  // пишет тип и общие поля
-    out << baseRadius << ' '
-        << (int)outlineColor.r << ' ' << (int)outlineColor.g << ' ' << (int)outlineColor.b << ' '
-        << outlineThickness << '\n';
-}
-
-void Circle::deserialize(std::istream& in) {
-    AbstractFigure::deserialize(in);
-    int r,g,b;
-    in >> baseRadius >> r >> g >> b >> outlineThickness;
-    outlineColor = sf::Color(r,g,b);
+void Circle::readBinary(SceneReader& in) {
+    AbstractFigure::readBinary(in);
+    baseRadius = in.f32();
+    outlineColor = in.color();
+    outlineThickness = in.f32();
+    invalidateBounds();
 }
\ No newline at end of file
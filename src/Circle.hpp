@@ -3,21 +3,31 @@
 
 class Circle : public AbstractFigure {
 public:
+    static constexpr FigureKind Kind = FigureKind::Circle;
+
     Circle(float radius, const sf::Color& color, float thickness);
-    void draw(sf::RenderWindow& window) const override;
+    using AbstractFigure::draw;
+    void draw(sf::RenderTarget& target, const sf::Transform& parent) const override;
     bool contains(const sf::Vector2f& point) const override;
     sf::FloatRect getBoundingBox() const override;
+    sf::FloatRect getBoundsUnder(const sf::Transform& t) const override;
+    void tessellate(const sf::Transform& t, float worldScale, sf::VertexArray& out) const override;
     std::unique_ptr<AbstractFigure> clone() const override;
 
+    float getRadius() const { return baseRadius * getScale(); }
+    // Радиус без масштаба
+    float getBaseRadius() const { return baseRadius; }
+    // Центр в сцене и большая полуось: при неравномерном масштабе круг становится эллипсом
+    sf::Vector2f getWorldCenter() const { return getWorldTransform().transformPoint(0, 0); }
+    float getWorldRadius() const;
     float getOutlineThickness() const { return outlineThickness; }
-    void setOutlineThickness(float thickness) { outlineThickness = thickness; }
+    void setOutlineThickness(float thickness) { outlineThickness = thickness; invalidateBounds(); }
     sf::Color getOutlineColor() const { return outlineColor; }
-    void setOutlineColor(const sf::Color& color) { outlineColor = color; }
+    void setOutlineColor(const sf::Color& color) { outlineColor = color; invalidateStyle(); }
 
-    void serialize(std::ostream& out) const override;
-    void deserialize(std::istream& in) override;
+    void readBinary(SceneReader& in) override;
 
-    std::string getTypeName() const { return "Circle"; }
+    std::string_view getTypeName() const { return "Circle"; }
 private:
     float baseRadius;
     sf::Color outlineColor;
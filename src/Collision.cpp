@@ -0,0 +1,153 @@
+#include "Collision.hpp"
+#include "CompositeFigure.hpp"
+#include "Circle.hpp"
+#include "PolylineFigure.hpp"
+#include <algorithm>
+#include <cmath>
+
+bool boxesOverlap(const sf::FloatRect& a, const sf::FloatRect& b) {
+    return a.left <= b.left + b.width && b.left <= a.left + a.width &&
+           a.top <= b.top + b.height && b.top <= a.top + a.height;
+}
+
+// Мировые матрицы вложенных фигур уже учитывают группы над ними.
+// Эллипс (круг при неравномерном масштабе) заменяется кругом по большей полуоси
+static void collect(const AbstractFigure& fig, std::vector<CollisionShape>& out) {
+    if (auto* comp = figureCast<CompositeFigure>(&fig)) {
+        for (size_t i = 0; i < comp->getChildCount(); ++i)
+            collect(*comp->getChild(i), out);
+        return;
+    }
+
+    CollisionShape shape;
+    if (auto* circle = figureCast<Circle>(&fig)) {
+        shape.isCircle = true;
+        shape.center = circle->getWorldCenter();
+        shape.radius = circle->getWorldRadius();
+        shape.bounds = {shape.center.x - shape.radius, shape.center.y - shape.radius,
+                        2 * shape.radius, 2 * shape.radius};
+    } else {
+        size_t n = fig.getVertexCount();
+        if (n == 0) return;
+        if (auto* poly = figureCast<PolylineFigure>(&fig)) {
+            std::vector<sf::Vector2f> scratch;
+            const auto& world = poly->getWorldVertices(scratch);
+            shape.points.assign(world.begin(), world.end());
+        } else {
+            shape.points.reserve(n);
+            for (size_t i = 0; i < n; ++i)
+                shape.points.push_back(fig.getGlobalVertex(i));
+        }
+        float minX = shape.points[0].x, maxX = minX;
+        float minY = shape.points[0].y, maxY = minY;
+        for (const auto& p : shape.points) {
+            minX = std::min(minX, p.x); maxX = std::max(maxX, p.x);
+            minY = std::min(minY, p.y); maxY = std::max(maxY, p.y);
+        }
+        shape.bounds = {minX, minY, maxX - minX, maxY - minY};
+    }
+    out.push_back(std::move(shape));
+}
+
+void collectCollisionShapes(const AbstractFigure& fig, std::vector<CollisionShape>& out) {
+    collect(fig, out);
+}
+
+static float cross(const sf::Vector2f& o, const sf::Vector2f& a, const sf::Vector2f& b) {
+    return (a.x - o.x) * (b.y - o.y) - (a.y - o.y) * (b.x - o.x);
+}
+
+static bool onSegment(const sf::Vector2f& a, const sf::Vector2f& b, const sf::Vector2f& p) {
+    return std::min(a.x, b.x) <= p.x && p.x <= std::max(a.x, b.x) &&
+           std::min(a.y, b.y) <= p.y && p.y <= std::max(a.y, b.y);
+}
+
+static bool segmentsIntersect(const sf::Vector2f& a, const sf::Vector2f& b,
+                              const sf::Vector2f& c, const sf::Vector2f& d) {
+    float d1 = cross(c, d, a), d2 = cross(c, d, b);
+    float d3 = cross(a, b, c), d4 = cross(a, b, d);
+    if (((d1 > 0 && d2 < 0) || (d1 < 0 && d2 > 0)) &&
+        ((d3 > 0 && d4 < 0) || (d3 < 0 && d4 > 0)))
+        return true;
+    if (d1 == 0 && onSegment(c, d, a)) return true;
+    if (d2 == 0 && onSegment(c, d, b)) return true;
+    if (d3 == 0 && onSegment(a, b, c)) return true;
+    if (d4 == 0 && onSegment(a, b, d)) return true;
+    return false;
+}
+
+// Правило чёт-нечет, контур считается замкнутым
+static bool pointInPolygon(const std::vector<sf::Vector2f>& poly, const sf::Vector2f& p) {
+    bool inside = false;
+    size_t n = poly.size();
+    if (n < 3) return false;
+    for (size_t i = 0, j = n - 1; i < n; j = i++) {
+        const sf::Vector2f& a = poly[i];
+        const sf::Vector2f& b = poly[j];
+        if ((a.y > p.y) != (b.y > p.y) &&
+            p.x < (b.x - a.x) * (p.y - a.y) / (b.y - a.y) + a.x)
+            inside = !inside;
+    }
+    return inside;
+}
+
+static float distanceSqToSegment(const sf::Vector2f& p, const sf::Vector2f& a, const sf::Vector2f& b) {
+    sf::Vector2f ab = b - a;
+    float len2 = ab.x * ab.x + ab.y * ab.y;
+    float t = len2 > 0 ? ((p.x - a.x) * ab.x + (p.y - a.y) * ab.y) / len2 : 0.f;
+    t = std::clamp(t, 0.f, 1.f);
+    sf::Vector2f q = a + ab * t - p;
+    return q.x * q.x + q.y * q.y;
+}
+
+static bool polygonsIntersect(const std::vector<sf::Vector2f>& a, const std::vector<sf::Vector2f>& b) {
+    size_t n = a.size(), m = b.size();
+    for (size_t i = 0; i < n; ++i) {
+        const sf::Vector2f& a1 = a[i];
+        const sf::Vector2f& a2 = a[(i + 1) % n];
+        for (size_t j = 0; j < m; ++j) {
+            if (segmentsIntersect(a1, a2, b[j], b[(j + 1) % m]))
+                return true;
+        }
+    }
+    // Рёбра не пересекаются — возможна только вложенность
+    return pointInPolygon(b, a[0]) || pointInPolygon(a, b[0]);
+}
+
+static bool circlePolygonIntersect(const CollisionShape& circle, const std::vector<sf::Vector2f>& poly) {
+    if (pointInPolygon(poly, circle.center)) return true;
+    float r2 = circle.radius * circle.radius;
+    size_t n = poly.size();
+    for (size_t i = 0; i < n; ++i) {
+        if (distanceSqToSegment(circle.center, poly[i], poly[(i + 1) % n]) <= r2)
+            return true;
+    }
+    return false;
+}
+
+bool shapesIntersect(const CollisionShape& a, const CollisionShape& b) {
+    if (!boxesOverlap(a.bounds, b.bounds)) return false;
+    if (a.isCircle && b.isCircle) {
+        sf::Vector2f d = a.center - b.center;
+        float r = a.radius + b.radius;
+        return d.x * d.x + d.y * d.y <= r * r;
+    }
+    if (a.isCircle) return circlePolygonIntersect(a, b.points);
+    if (b.isCircle) return circlePolygonIntersect(b, a.points);
+    return polygonsIntersect(a.points, b.points);
+}
+
+bool shapesIntersect(const std::vector<CollisionShape>& a, const std::vector<CollisionShape>& b) {
+    for (const auto& sa : a)
+        for (const auto& sb : b)
+            if (shapesIntersect(sa, sb)) return true;
+    return false;
+}
+
+bool figuresIntersect(const AbstractFigure& a, const AbstractFigure& b) {
+    if (!boxesOverlap(a.getBoundingBox(), b.getBoundingBox())) return false;
+    std::vector<CollisionShape> sa, sb;
+    collectCollisionShapes(a, sa);
+    collectCollisionShapes(b, sb);
+    return shapesIntersect(sa, sb);
+}
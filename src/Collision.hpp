@@ -0,0 +1,22 @@
+#pragma once
+#include "AbstractFigure.hpp"
+#include <vector>
+
+// Геометрия листовой фигуры в мировых координатах (толщина линий не учитывается)
+struct CollisionShape {
+    bool isCircle = false;
+    sf::Vector2f center;
+    float radius = 0.f;
+    std::vector<sf::Vector2f> points;   // замкнутый контур многоугольника
+    sf::FloatRect bounds;
+};
+
+// Раскладывает фигуру (группы — рекурсивно) на листовые формы
+void collectCollisionShapes(const AbstractFigure& fig, std::vector<CollisionShape>& out);
+
+bool shapesIntersect(const CollisionShape& a, const CollisionShape& b);
+bool shapesIntersect(const std::vector<CollisionShape>& a, const std::vector<CollisionShape>& b);
+bool figuresIntersect(const AbstractFigure& a, const AbstractFigure& b);
+
+// Пересечение прямоугольников с учётом касания краёв
+bool boxesOverlap(const sf::FloatRect& a, const sf::FloatRect& b);
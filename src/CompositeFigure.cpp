@@ -1,53 +1,160 @@
 #include "CompositeFigure.hpp"
+#include "SceneBinary.hpp"
 #include <algorithm>
+#include <cmath>
 
-CompositeFigure::CompositeFigure() : AbstractFigure() {}
+CompositeFigure::CompositeFigure() : AbstractFigure(Kind) {}
 
 std::unique_ptr<AbstractFigure> CompositeFigure::clone() const {
     auto newComp = std::make_unique<CompositeFigure>();
-    newComp->position = position;
-    newComp->scaleFactor = scaleFactor;
-    newComp->fillColor = fillColor;
-    newComp->filled = filled;
+    newComp->setPosition(getPosition());
+    newComp->setScale(getScaleXY());
+    newComp->setRotation(getRotation());
+    newComp->setFillColor(getFillColor());
+    newComp->setFilled(isFilled());
     newComp->pivot = pivot;
     for (const auto& child : children) {
         newComp->addFigure(child.figure->clone(), child.localOffset);
     }
+    newComp->frozen = frozen;
     return newComp;
 }
 
 void CompositeFigure::addFigure(std::unique_ptr<AbstractFigure> fig, const sf::Vector2f& localPos) {
+    fig->setParent(this, localPos);
     children.push_back({std::move(fig), localPos});
+    onChildBoundsChanged();
+}
+
+void CompositeFigure::insertFigure(size_t index, std::unique_ptr<AbstractFigure> fig, const sf::Vector2f& localPos) {
+    index = std::min(index, children.size());
+    fig->setParent(this, localPos);
+    children.insert(children.begin() + index, Child{std::move(fig), localPos});
+    onChildBoundsChanged();
 }
 
 void CompositeFigure::removeFigure(size_t index) {
-    if (index < children.size())
+    if (index < children.size()) {
         children.erase(children.begin() + index);
+        onChildBoundsChanged();
+    }
 }
 
 std::unique_ptr<AbstractFigure> CompositeFigure::extractFigure(size_t index) {
     if (index >= children.size()) return nullptr;
     auto fig = std::move(children[index].figure);
+    fig->setParent(nullptr);
     children.erase(children.begin() + index);
+    onChildBoundsChanged();
     return fig;
 }
 
-void CompositeFigure::draw(sf::RenderWindow& window) const {
-    for (const auto& child : children) {
-        sf::Vector2f originalPos = child.figure->getPosition();
-        child.figure->setPosition(position + child.localOffset);
-        child.figure->draw(window);
-        child.figure->setPosition(originalPos);
+void CompositeFigure::onChildBoundsChanged() {
+    bvhDirty = true;
+    meshDirty = true;
+    invalidateBounds();
+}
+
+void CompositeFigure::onChildStyleChanged() {
+    meshDirty = true;
+    invalidateStyle();
+}
+
+void CompositeFigure::freeze() {
+    frozen = true;
+    meshDirty = true;
+}
+
+void CompositeFigure::thaw() {
+    frozen = false;
+    mesh.clear();
+}
+
+// Мировые матрицы детей уже включают преобразование группы
+void CompositeFigure::draw(sf::RenderTarget& target, const sf::Transform& parent) const {
+    if (frozen) {
+        const sf::Transform& world = getWorldTransform();
+        sf::Vector2f s = axisScales(world);
+        float worldScale = (s.x + s.y) / 2;
+        if (!meshDirty && worldScale == meshScale) {
+            target.draw(mesh, parent * world);
+        } else {
+            sf::VertexArray scratch(sf::Triangles);
+            tessellate(sf::Transform::Identity, worldScale, scratch);
+            target.draw(scratch, parent * world);
+        }
+        return;
+    }
+    for (const auto& child : children)
+        child.figure->draw(target, parent);
+}
+
+// Матрицы детей зависят от матрицы группы, поэтому обновляются после неё
+void CompositeFigure::refreshWorld() {
+    AbstractFigure::refreshWorld();
+    if (bvhDirty) rebuildBvh();
+    for (const auto& child : children)
+        child.figure->refreshWorld();
+    if (frozen) {
+        sf::Vector2f s = axisScales(FigureStore::instance().world(entity));
+        float worldScale = (s.x + s.y) / 2;
+        if (meshDirty || worldScale != meshScale) rebuildMesh(worldScale);
     }
 }
 
+void CompositeFigure::tessellate(const sf::Transform& t, float worldScale, sf::VertexArray& out) const {
+    for (const auto& child : children)
+        child.figure->tessellate(t * child.figure->getLocalTransform(), worldScale, out);
+}
+
+void CompositeFigure::rebuildMesh(float worldScale) {
+    mesh.clear();
+    tessellate(sf::Transform::Identity, worldScale, mesh);
+    meshScale = worldScale;
+    meshDirty = false;
+}
+
+// Лежит ли point в мировой рамке образа box под матрицей m: центр рамки
+// переводится матрицей, а полуразмеры — её модулями
+static bool worldRectContains(const float* m, const sf::FloatRect& box, const sf::Vector2f& point) {
+    float hx = box.width / 2, hy = box.height / 2;
+    float cx = box.left + hx, cy = box.top + hy;
+    float wx = m[0] * cx + m[4] * cy + m[12];
+    float wy = m[1] * cx + m[5] * cy + m[13];
+    return std::abs(point.x - wx) <= std::abs(m[0]) * hx + std::abs(m[4]) * hy &&
+           std::abs(point.y - wy) <= std::abs(m[1]) * hx + std::abs(m[5]) * hy;
+}
+
+// Рамки узлов BVH хранятся в локальных координатах группы, а сравниваются в
+// сцене: фигуры попадают по точке в своей мировой рамке, и под поворотом она
+// выходит за образ локальной рамки, так что проверка точки в локальных
+// координатах теряла бы попадания у углов. Пока BVH устарел, проверяются все
+// дети по очереди
 bool CompositeFigure::contains(const sf::Vector2f& point) const {
-    for (const auto& child : children) {
-        sf::Vector2f originalPos = child.figure->getPosition();
-        child.figure->setPosition(position + child.localOffset);
-        bool res = child.figure->contains(point);
-        child.figure->setPosition(originalPos);
-        if (res) return true;
+    if (children.empty()) return false;
+    if (bvhDirty) {
+        for (const auto& child : children) {
+            if (child.figure->contains(point)) return true;
+        }
+        return false;
+    }
+
+    sf::Transform world = getWorldTransform();
+    const float* m = world.getMatrix();
+    int stack[64];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        const BvhNode& node = bvh[stack[--top]];
+        if (!worldRectContains(m, node.box, point)) continue;
+        if (node.left < 0) {
+            for (size_t i = node.first; i < node.first + node.count; ++i) {
+                if (children[bvhOrder[i]].figure->contains(point)) return true;
+            }
+        } else {
+            stack[top++] = node.left;
+            stack[top++] = node.right;
+        }
     }
     return false;
 }
@@ -80,67 +187,97 @@ void CompositeFigure::deserialize(std::istream& in) {
 }
 */
 
-void CompositeFigure::serialize(std::ostream& out) const {
-    AbstractFigure::serialize(out); // Записывает "Composite" и общие поля
-    out << children.size() << '\n';
-    for (const auto& child : children) {
-        // НЕ пишем тип здесь вручную, он запишется внутри child->serialize()
-        child.figure->serialize(out); 
-        out << child.localOffset.x << ' ' << child.localOffset.y << '\n';
+void CompositeFigure::readBinary(SceneReader& in) {
+    AbstractFigure::readBinary(in);
+    // Ребёнок занимает хотя бы смещение и длину записи
+    size_t count = in.count(sizeof(sf::Vector2f) + sizeof(uint32_t));
+    children.clear();
+    children.reserve(count);
+    for (size_t i = 0; i < count && in.ok(); ++i) {
+        sf::Vector2f offset = in.vec();
+        // Запись неизвестного типа пропускается по её длине
+        if (auto child = in.readFigure()) addFigure(std::move(child), offset);
     }
+    onChildBoundsChanged();
 }
 
-void CompositeFigure::deserialize(std::istream& in) {
-    AbstractFigure::deserialize(in);
-    size_t count;
-    if (!(in >> count)) return;
-
-    children.clear();
-    for (size_t i = 0; i < count; ++i) {
-        std::string childType;
-        if (!(in >> childType)) break; // Читаем тип, который записала AbstractFigure::serialize
+sf::FloatRect CompositeFigure::getBoundingBox() const {
+    return getBoundsUnder(getWorldTransform());
+}
 
-        auto child = FigureManager::instance().create(childType);
-        if (child) {
-            child->deserialize(in); // Объект читает свои данные (уже без типа)
-            sf::Vector2f offset;
-            in >> offset.x >> offset.y;
-            children.push_back({std::move(child), offset});
-        }
+// Переводятся углы общей рамки детей: при повороте рамка выходит с запасом
+sf::FloatRect CompositeFigure::getBoundsUnder(const sf::Transform& t) const {
+    if (children.empty()) {
+        sf::Vector2f origin = t.transformPoint(0, 0);
+        return {origin.x, origin.y, 0, 0};
     }
+    return t.transformRect(childrenBounds());
 }
 
-sf::FloatRect CompositeFigure::getBoundingBox() const {
-    if (children.empty()) return {position.x, position.y, 0, 0};
+static sf::FloatRect unite(const sf::FloatRect& a, const sf::FloatRect& b) {
+    float left = std::min(a.left, b.left);
+    float top = std::min(a.top, b.top);
+    float right = std::max(a.left + a.width, b.left + b.width);
+    float bottom = std::max(a.top + a.height, b.top + b.height);
+    return {left, top, right - left, bottom - top};
+}
 
-    sf::FloatRect total;
-    bool first = true;
+sf::FloatRect CompositeFigure::childLocalBounds(const Child& child) const {
+    return child.figure->getBoundsUnder(child.figure->getLocalTransform());
+}
 
-    for (const auto& child : children) {
-        // Сохраняем старую позицию
-        sf::Vector2f oldPos = child.figure->getPosition();
-        
-        // Устанавливаем актуальную позицию для расчетов (позиция группы + смещение)
-        child.figure->setPosition(this->position + child.localOffset);
-        
-        sf::FloatRect box = child.figure->getBoundingBox();
-        
-        // Возвращаем как было
-        child.figure->setPosition(oldPos);
-
-        if (first) {
-            total = box;
-            first = false;
-        } else {
-            float left = std::min(total.left, box.left);
-            float top = std::min(total.top, box.top);
-            float right = std::max(total.left + total.width, box.left + box.width);
-            float bottom = std::max(total.top + total.height, box.top + box.height);
-            total.left = left;
-            total.top = top;
-            total.width = right - left;
-            total.height = bottom - top;
-        }
+sf::FloatRect CompositeFigure::childrenBounds() const {
+    if (!bvhDirty) return localBounds;
+    sf::FloatRect box = childLocalBounds(children[0]);
+    for (size_t i = 1; i < children.size(); ++i)
+        box = unite(box, childLocalBounds(children[i]));
+    return box;
+}
+
+void CompositeFigure::rebuildBvh() {
+    bvh.clear();
+    bvhOrder.resize(children.size());
+    std::vector<sf::FloatRect> boxes(children.size());
+    for (size_t i = 0; i < children.size(); ++i) {
+        bvhOrder[i] = i;
+        boxes[i] = childLocalBounds(children[i]);
     }
-    return total;
-}
\ No newline at end of file
+    if (!children.empty()) {
+        bvh.reserve(2 * children.size());
+        buildNode(boxes, 0, children.size());
+        localBounds = bvh[0].box;
+    }
+    bvhDirty = false;
+}
+
+// Делим по медиане центров вдоль длинной оси; в листе не больше 4 детей
+int CompositeFigure::buildNode(std::vector<sf::FloatRect>& boxes, size_t first, size_t count) {
+    int index = (int)bvh.size();
+    bvh.emplace_back();
+    sf::FloatRect box = boxes[bvhOrder[first]];
+    for (size_t i = first + 1; i < first + count; ++i)
+        box = unite(box, boxes[bvhOrder[i]]);
+    bvh[index].box = box;
+
+    if (count <= 4) {
+        bvh[index].first = first;
+        bvh[index].count = count;
+        return index;
+    }
+
+    bool splitX = box.width >= box.height;
+    auto center = [&](size_t c) {
+        const sf::FloatRect& b = boxes[c];
+        return splitX ? b.left + b.width / 2 : b.top + b.height / 2;
+    };
+    size_t half = count / 2;
+    std::nth_element(bvhOrder.begin() + first, bvhOrder.begin() + first + half,
+                     bvhOrder.begin() + first + count,
+                     [&](size_t a, size_t b) { return center(a) < center(b); });
+
+    int left = buildNode(boxes, first, half);
+    int right = buildNode(boxes, first + half, count - half);
+    bvh[index].left = left;
+    bvh[index].right = right;
+    return index;
+}
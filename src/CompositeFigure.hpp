@@ -6,13 +6,21 @@
 
 class CompositeFigure : public AbstractFigure {
 public:
+    static constexpr FigureKind Kind = FigureKind::Composite;
+
     CompositeFigure();
-    void draw(sf::RenderWindow& window) const override;
+    using AbstractFigure::draw;
+    void draw(sf::RenderTarget& target, const sf::Transform& parent) const override;
     bool contains(const sf::Vector2f& point) const override;
     sf::FloatRect getBoundingBox() const override;
+    sf::FloatRect getBoundsUnder(const sf::Transform& t) const override;
+    void tessellate(const sf::Transform& t, float worldScale, sf::VertexArray& out) const override;
     std::unique_ptr<AbstractFigure> clone() const override;
+    // Заодно собирает BVH и массив замороженной группы
+    void refreshWorld() override;
 
     void addFigure(std::unique_ptr<AbstractFigure> fig, const sf::Vector2f& localPos);
+    void insertFigure(size_t index, std::unique_ptr<AbstractFigure> fig, const sf::Vector2f& localPos);
     void removeFigure(size_t index);
     size_t getFigureCount() const { return children.size(); }
     AbstractFigure* getFigure(size_t index) { return children[index].figure.get(); }
@@ -22,14 +30,49 @@ public:
     AbstractFigure* getChild(size_t index) const { return children[index].figure.get(); }
     sf::Vector2f getChildOffset(size_t index) const { return children[index].localOffset; }
 
+    // Замороженная группа сводит всё поддерево в один массив треугольников в своих
+    // локальных координатах и рисуется одним вызовом под своей мировой матрицей.
+    // Массив пересобирает refreshWorld после изменения любого потомка; до этого
+    // draw строит его во временный
+    void freeze();
+    void thaw();
+    bool isFrozen() const { return frozen; }
+
+    void readBinary(SceneReader& in) override;
 
-    void serialize(std::ostream& out) const override;
-    void deserialize(std::istream& in) override;
+protected:
+    void onChildBoundsChanged() override;
+    void onChildStyleChanged() override;
 
 private:
     struct Child {
         std::unique_ptr<AbstractFigure> figure;
         sf::Vector2f localOffset;
     };
+    // Узел BVH по границам детей в локальных координатах группы
+    struct BvhNode {
+        sf::FloatRect box;
+        int left = -1, right = -1;      // -1 у листа
+        size_t first = 0, count = 0;    // диапазон в bvhOrder для листа
+    };
+
+    sf::FloatRect childLocalBounds(const Child& child) const;
+    // Общая рамка детей в локальных координатах: из BVH, а если он устарел — посчитанная заново
+    sf::FloatRect childrenBounds() const;
+    void rebuildBvh();
+    void rebuildMesh(float worldScale);
+    int buildNode(std::vector<sf::FloatRect>& boxes, size_t first, size_t count);
+
+    // BVH и массив строит только refreshWorld: const-методы кэши не пишут
     std::vector<Child> children;
+    std::vector<BvhNode> bvh;
+    std::vector<size_t> bvhOrder;
+    sf::FloatRect localBounds;
+    bool bvhDirty = true;
+
+    bool frozen = false;
+    sf::VertexArray mesh{sf::Triangles};
+    // Масштаб группы в сцене при сборке: толщины линий в массиве пересчитаны под него
+    float meshScale = 0.f;
+    bool meshDirty = true;
 };
\ No newline at end of file
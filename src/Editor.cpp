@@ -1,44 +1,351 @@
 #include "Editor.hpp"
 #include "CompositeFigure.hpp"
+#include "Collision.hpp"
+#include "PolylineFigure.hpp"
+#include "SceneBinary.hpp"
+#include "SceneText.hpp"
+#include "TextStream.hpp"
 #include <algorithm>
 #include <fstream>
+#include <cstdio>
 #include <iostream>
 #include <cmath>
+#include <unordered_set>
 
-Editor::Editor() {
-    for (int i = 0; i < MAX_FIGURES; ++i) figures[i] = nullptr;
+// Шаг между соседними ключами порядка и ключ первой фигуры (середина диапазона,
+// чтобы хватало места и вперёд, и назад)
+static constexpr uint64_t ZGap = uint64_t(1) << 20;
+static constexpr uint64_t ZStart = uint64_t(1) << 62;
+
+Editor::Editor() : arena(new FigureArena()) {
+    FigureArena::setCurrent(arena);
 }
 
 Editor::~Editor() {
-    for (int i = 0; i < figureCount; ++i) delete figures[i];
+    change.reset();
+    clear();
+    arena->retire();
+}
+
+FigureHandle Editor::addFigure(AbstractFigure* fig) {
+    ChangeScope scope(*this);
+    if (!zOrder.empty() && zOrder.rbegin()->first > UINT64_MAX - ZGap) renumber();
+    uint64_t z = zOrder.empty() ? ZStart : zOrder.rbegin()->first + ZGap;
+    FigureHandle handle = attachAt(std::unique_ptr<AbstractFigure>(fig), z);
+    if (change) {
+        change->attachTop(fig, z);
+        checkBudget();
+    }
+    return handle;
+}
+
+void Editor::addFigures(std::vector<std::unique_ptr<AbstractFigure>>& figs) {
+    if (figs.empty()) return;
+    ChangeScope scope(*this);
+    if (!zOrder.empty() && zOrder.rbegin()->first > UINT64_MAX - ZGap * (figs.size() + 1)) renumber();
+    uint64_t z = zOrder.empty() ? ZStart - ZGap : zOrder.rbegin()->first;
+    // Таблицы растут вдвое, а не на размер пачки, иначе каждая пачка перестраивала бы их
+    size_t total = figures.size() + figs.size();
+    if (total > order.capacity()) {
+        size_t grown = std::max(total, order.capacity() * 2);
+        figures.reserve(grown);
+        handles.reserve(grown);
+        order.reserve(grown);
+    }
+    for (auto& fig : figs) {
+        z += ZGap;
+        AbstractFigure* raw = fig.get();
+        FigureHandle handle = figures.insert(std::move(fig));
+        handles.emplace(raw, Placement{handle, z});
+        zOrder.emplace_hint(zOrder.end(), z, handle);
+        if (!orderDirty) order.push_back(handle);
+        linkChildren(raw);
+        if (change) change->attachTop(raw, z);
+    }
+    figs.clear();
+    if (change) checkBudget();
+}
+
+FigureHandle Editor::attachAt(std::unique_ptr<AbstractFigure> fig, uint64_t z) {
+    while (zOrder.count(z)) ++z;
+    AbstractFigure* raw = fig.get();
+    FigureHandle handle = figures.insert(std::move(fig));
+    handles[raw] = {handle, z};
+    bool last = zOrder.empty() || zOrder.rbegin()->first < z;
+    zOrder.emplace(z, handle);
+    if (!orderDirty) {
+        if (last) order.push_back(handle);
+        else orderDirty = true;
+    }
+    parents.erase(raw);
+    linkChildren(raw);
+    return handle;
+}
+
+std::unique_ptr<AbstractFigure> Editor::detachTop(AbstractFigure* fig) {
+    unlinkSubtree(fig);
+    return take(getHandle(fig));
+}
+
+void Editor::attachToGroup(CompositeFigure* group, size_t index, std::unique_ptr<AbstractFigure> fig,
+                           const sf::Vector2f& offset) {
+    AbstractFigure* raw = fig.get();
+    group->insertFigure(index, std::move(fig), offset);
+    for (size_t i = index; i < group->getChildCount(); ++i)
+        parents[group->getChild(i)] = {group, i};
+    linkChildren(raw);
+}
+
+std::unique_ptr<AbstractFigure> Editor::detachFromGroup(CompositeFigure* group, size_t index) {
+    AbstractFigure* child = group->getChild(index);
+    unlinkSubtree(child);
+    parents.erase(child);
+    auto fig = group->extractFigure(index);
+    for (size_t i = index; i < group->getChildCount(); ++i)
+        parents[group->getChild(i)] = {group, i};
+    return fig;
+}
+
+uint64_t Editor::setZ(AbstractFigure* fig, uint64_t z) {
+    Placement& placement = handles.at(fig);
+    uint64_t old = placement.z;
+    zOrder.erase(old);
+    while (zOrder.count(z)) ++z;
+    placement.z = z;
+    zOrder.emplace(z, placement.handle);
+    orderDirty = true;
+    FigureStore::instance().markChanged(fig->getEntity());
+    return old;
+}
+
+void Editor::addToGroup(CompositeFigure* group, std::unique_ptr<AbstractFigure> fig, const sf::Vector2f& offset) {
+    ChangeScope scope(*this);
+    AbstractFigure* raw = fig.get();
+    size_t index = group->getChildCount();
+    attachToGroup(group, index, std::move(fig), offset);
+    if (change) {
+        change->attachChild(raw, group, index, offset);
+        checkBudget();
+    }
 }
 
-void Editor::addFigure(AbstractFigure* fig) {
-    if (figureCount < MAX_FIGURES) {
-        figures[figureCount++] = fig;
+void Editor::beginChange(const std::vector<AbstractFigure*>& figs) {
+    if (changeDepth++ == 0) change = loadOpen ? std::move(loading) : std::make_unique<SceneChange>();
+    touch(figs);
+}
+
+void Editor::touch(AbstractFigure* fig) {
+    if (!change) return;
+    change->capture(fig);
+    checkBudget();
+}
+
+void Editor::touch(const std::vector<AbstractFigure*>& figs) {
+    for (AbstractFigure* fig : figs) touch(fig);
+}
+
+void Editor::endChange() {
+    if (changeDepth == 0 || --changeDepth > 0) return;
+    // Загрузка ещё идёт: правка ждёт следующих пачек
+    if (loadOpen) {
+        loading = std::move(change);
+        return;
+    }
+    if (change && change->finish()) history.push(std::move(change));
+    change.reset();
+}
+
+void Editor::checkBudget() {
+    if (change->recordedBytes() <= history.getBudget()) return;
+    history.clear();
+    change.reset();
+    loadOpen = false;
+}
+
+void Editor::beginLoad() {
+    endLoad();
+    applyPendingDrag();
+    // Перетаскивание заканчивается до замены сцены и записывается отдельно
+    if (dragging) {
+        dragging = false;
+        endChange();
+    }
+    ChangeScope scope(*this);
+    // Прежняя сцена целиком уйдёт в limbo: если ей там не хватит бюджета, проще
+    // сразу всё очистить, чем записывать и выбрасывать по фигуре
+    size_t sceneBytes = 0;
+    for (const auto& entry : zOrder) sceneBytes += SceneChange::figureBytes(getFigure(entry.second));
+    if (!change || change->recordedBytes() + sceneBytes > history.getBudget()) {
+        clear();
+        return;
+    }
+    loadOpen = true;
+    // Уходят все фигуры верхнего уровня: таблицы сцены очищаются разом, а не по одной
+    change->dropScene(zOrder.size());
+    for (const auto& entry : zOrder) {
+        std::unique_ptr<AbstractFigure> fig = figures.take(entry.second);
+        AbstractFigure* raw = fig.get();
+        unlinkSubtree(raw);
+        change->dropTop(raw, entry.first, std::move(fig));
     }
+    handles.clear();
+    zOrder.clear();
+    order.clear();
+    orderDirty = false;
+    selectedFigure = nullptr;
+}
+
+void Editor::endLoad() {
+    if (!loadOpen) return;
+    loadOpen = false;
+    // Внутри правки загрузку запишет внешний endChange
+    if (changeDepth > 0) return;
+    if (loading && loading->finish()) history.push(std::move(loading));
+    loading.reset();
+}
+
+bool Editor::undo() {
+    return changeDepth == 0 && !loadOpen && history.undo(*this);
+}
+
+bool Editor::redo() {
+    return changeDepth == 0 && !loadOpen && history.redo(*this);
+}
+
+// Заодно отмечает поддерево изменившимся: его записи в снимке создаются или удаляются
+void Editor::linkChildren(AbstractFigure* fig) {
+    FigureStore::instance().markChanged(fig->getEntity());
+    if (auto* comp = figureCast<CompositeFigure>(fig)) {
+        for (size_t i = 0; i < comp->getChildCount(); ++i) {
+            parents[comp->getChild(i)] = {comp, i};
+            linkChildren(comp->getChild(i));
+        }
+    }
+}
+
+// Забывает потомков fig; выделение внутри удаляемого поддерева сбрасывается
+void Editor::unlinkSubtree(AbstractFigure* fig) {
+    FigureStore::instance().markChanged(fig->getEntity());
+    if (fig == selectedFigure) selectedFigure = nullptr;
+    if (auto* comp = figureCast<CompositeFigure>(fig)) {
+        for (size_t i = 0; i < comp->getChildCount(); ++i) {
+            parents.erase(comp->getChild(i));
+            unlinkSubtree(comp->getChild(i));
+        }
+    }
+}
+
+CompositeFigure* Editor::findParent(const AbstractFigure* fig, size_t* index) const {
+    auto it = parents.find(fig);
+    if (it == parents.end()) return nullptr;
+    ParentLink& link = it->second;
+    // Группу могли поменять в обход редактора: сверяемся с владельцем и чиним запись
+    if (fig->getParent() != link.parent) {
+        parents.erase(it);
+        return nullptr;
+    }
+    if (link.index >= link.parent->getChildCount() || link.parent->getChild(link.index) != fig) {
+        for (size_t i = 0; i < link.parent->getChildCount(); ++i)
+            if (link.parent->getChild(i) == fig) link.index = i;
+    }
+    if (index) *index = link.index;
+    return link.parent;
+}
+
+sf::Vector2f Editor::getDrawPosition(const AbstractFigure* fig) const {
+    size_t index = 0;
+    if (CompositeFigure* parent = findParent(fig, &index))
+        return parent->getWorldTransform().transformPoint(parent->getChildOffset(index));
+    return fig->getPosition();
+}
+
+std::unique_ptr<AbstractFigure> Editor::extractFromGroup(AbstractFigure* child) {
+    size_t index = 0;
+    CompositeFigure* parent = findParent(child, &index);
+    if (!parent) return nullptr;
+    ChangeScope scope(*this);
+    sf::Vector2f offset = parent->getChildOffset(index);
+    auto fig = detachFromGroup(parent, index);
+    if (change) {
+        change->detachChild(child, parent, index, offset, nullptr);
+        checkBudget();
+    }
+    return fig;
+}
+
+std::unique_ptr<AbstractFigure> Editor::take(FigureHandle handle) {
+    std::unique_ptr<AbstractFigure> fig = figures.take(handle);
+    auto it = handles.find(fig.get());
+    zOrder.erase(it->second.z);
+    handles.erase(it);
+    orderDirty = true;
+    if (selectedFigure == fig.get()) selectedFigure = nullptr;
+    return fig;
+}
+
+// При записи удалённая фигура переходит к правке и живёт, пока её можно вернуть
+bool Editor::removeFigure(FigureHandle handle) {
+    if (!figures.contains(handle)) return false;
+    ChangeScope scope(*this);
+    AbstractFigure* fig = getFigure(handle);
+    uint64_t z = handles.at(fig).z;
+    auto owned = detachTop(fig);
+    if (change) {
+        change->detachTop(fig, z, std::move(owned));
+        checkBudget();
+    }
+    return true;
 }
 
 bool Editor::removeFigure(AbstractFigure* fig) {
-    for (int i = 0; i < figureCount; ++i) {
-        if (figures[i] == fig) {
-            delete figures[i];
-            for (int j = i; j < figureCount - 1; ++j) {
-                figures[j] = figures[j + 1];
-            }
-            figures[--figureCount] = nullptr;
-            if (selectedFigure == fig) selectedFigure = nullptr;
-            return true;
+    size_t index = 0;
+    if (CompositeFigure* parent = figures.contains(getHandle(fig)) ? nullptr : findParent(fig, &index)) {
+        ChangeScope scope(*this);
+        sf::Vector2f offset = parent->getChildOffset(index);
+        auto owned = detachFromGroup(parent, index);
+        if (change) {
+            change->detachChild(fig, parent, index, offset, std::move(owned));
+            checkBudget();
         }
+        return true;
+    }
+    return removeFigure(getHandle(fig));
+}
+
+// Сцена целиком заменяется: откатывать её к прежней нечего, история сбрасывается
+void Editor::clear() {
+    history.clear();
+    if (change) change.reset();
+    loading.reset();
+    loadOpen = false;
+    if (dragging && changeDepth > 0) --changeDepth;
+    figures.clear();
+    handles.clear();
+    zOrder.clear();
+    order.clear();
+    parents.clear();
+    orderDirty = false;
+    records.clear();
+    selectedFigure = nullptr;
+    dragging = false;
+    dragPending = false;
+    // Фигуры разрушаются по одной (у них записи в FigureStore и массивы в пулах
+    // геометрии), а память пула отдаётся целиком. Живые блоки остаются, только если
+    // вынутую фигуру держат дольше сцены; тогда старый пул доживает сам
+    if (!arena->release()) {
+        arena->retire();
+        arena = new FigureArena();
+        FigureArena::setCurrent(arena);
     }
-    return false;
 }
 
 void Editor::removeSelected() {
     if (selectedFigure) {
         removeFigure(selectedFigure);
         selectedFigure = nullptr;
+        if (dragging) endChange();
         dragging = false;
+        dragPending = false;
     }
 }
 
@@ -51,81 +358,362 @@ void Editor::setSelected(AbstractFigure* fig) {
 }
 
 bool Editor::isSelectedValid() const {
-    if (!selectedFigure) return false;
-    for (int i = 0; i < figureCount; ++i)
-        if (figures[i] == selectedFigure) return true;
-    return false;
+    return selectedFigure && handles.count(selectedFigure) > 0;
+}
+
+const std::vector<FigureHandle>& Editor::drawOrder() const {
+    if (orderDirty) {
+        order.clear();
+        order.reserve(zOrder.size());
+        for (const auto& entry : zOrder) order.push_back(entry.second);
+        orderDirty = false;
+    }
+    return order;
+}
+
+void Editor::renumber() {
+    std::map<uint64_t, FigureHandle> renumbered;
+    std::vector<uint64_t> oldKeys;
+    oldKeys.reserve(zOrder.size());
+    uint64_t z = ZStart;
+    for (const auto& entry : zOrder) {
+        oldKeys.push_back(entry.first);
+        AbstractFigure* fig = getFigure(entry.second);
+        handles[fig].z = z;
+        FigureStore::instance().markChanged(fig->getEntity());
+        renumbered.emplace_hint(renumbered.end(), z, entry.second);
+        z += ZGap;
+    }
+    zOrder.swap(renumbered);
+
+    // Ключи в истории: живые фигуры получают новые ключи, а ключи фигур вне сцены
+    // равномерно делят промежуток между теми же соседями, не меняя порядка
+    std::vector<uint64_t> keys;
+    auto collect = [&](uint64_t key) { keys.push_back(key); return key; };
+    history.remapZ(collect);
+    if (change) change->remapZ(collect);
+    if (keys.empty()) return;
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    std::vector<uint64_t> mapped(keys.size());
+    for (size_t i = 0; i < keys.size();) {
+        size_t rank = std::lower_bound(oldKeys.begin(), oldKeys.end(), keys[i]) - oldKeys.begin();
+        uint64_t base = ZStart + rank * ZGap;
+        if (rank < oldKeys.size() && oldKeys[rank] == keys[i]) {
+            mapped[i++] = base;
+            continue;
+        }
+        size_t end = i;
+        while (end < keys.size() && (rank == oldKeys.size() || keys[end] < oldKeys[rank])) ++end;
+        uint64_t step = std::max<uint64_t>(ZGap / (end - i + 1), 1);
+        for (size_t j = i; j < end; ++j) mapped[j] = base - ZGap + (j - i + 1) * step;
+        i = end;
+    }
+    auto remap = [&](uint64_t key) {
+        return mapped[std::lower_bound(keys.begin(), keys.end(), key) - keys.begin()];
+    };
+    history.remapZ(remap);
+    if (change) change->remapZ(remap);
+}
+
+void Editor::placeBetween(AbstractFigure* fig, const AbstractFigure* below, const AbstractFigure* above) {
+    Placement& placement = handles.at(fig);
+    for (;;) {
+        uint64_t lo = below ? handles.at(below).z : 0;
+        uint64_t hi = above ? handles.at(above).z : UINT64_MAX;
+        uint64_t z;
+        if (!below && above) z = hi >= ZGap ? hi - ZGap : hi;
+        else if (below && !above) z = lo <= UINT64_MAX - ZGap ? lo + ZGap : lo;
+        else z = lo + (hi - lo) / 2;
+        if (z > lo && z < hi) {
+            if (change) change->moveZ(fig, placement.z);
+            zOrder.erase(placement.z);
+            placement.z = z;
+            zOrder.emplace(z, placement.handle);
+            orderDirty = true;
+            FigureStore::instance().markChanged(fig->getEntity());
+            return;
+        }
+        renumber();
+    }
+}
+
+// Фигуры верхнего уровня из figs по возрастанию ключа, без повторов
+std::vector<AbstractFigure*> Editor::sortedByZ(const std::vector<AbstractFigure*>& figs) const {
+    std::vector<AbstractFigure*> result;
+    for (AbstractFigure* fig : figs)
+        if (handles.count(fig)) result.push_back(fig);
+    std::sort(result.begin(), result.end(), [&](AbstractFigure* a, AbstractFigure* b) {
+        return handles.at(a).z < handles.at(b).z;
+    });
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    return result;
+}
+
+void Editor::bringToFront(const std::vector<AbstractFigure*>& figs) {
+    ChangeScope scope(*this);
+    for (AbstractFigure* fig : sortedByZ(figs)) {
+        AbstractFigure* top = getFigure(zOrder.rbegin()->second);
+        if (top != fig) placeBetween(fig, top, nullptr);
+    }
+}
+
+void Editor::sendToBack(const std::vector<AbstractFigure*>& figs) {
+    ChangeScope scope(*this);
+    auto sorted = sortedByZ(figs);
+    for (auto it = sorted.rbegin(); it != sorted.rend(); ++it) {
+        AbstractFigure* bottom = getFigure(zOrder.begin()->second);
+        if (bottom != *it) placeBetween(*it, nullptr, bottom);
+    }
+}
+
+// Сверху вниз: фигура перепрыгивает соседа, если он не из набора.
+// Так набор, упёршийся в край, не перемешивается
+void Editor::raise(const std::vector<AbstractFigure*>& figs) {
+    ChangeScope scope(*this);
+    auto sorted = sortedByZ(figs);
+    std::unordered_set<const AbstractFigure*> selected(sorted.begin(), sorted.end());
+    for (auto it = sorted.rbegin(); it != sorted.rend(); ++it) {
+        auto pos = zOrder.find(handles.at(*it).z);
+        auto next = std::next(pos);
+        if (next == zOrder.end()) continue;
+        AbstractFigure* neighbour = getFigure(next->second);
+        if (selected.count(neighbour)) continue;
+        auto after = std::next(next);
+        placeBetween(*it, neighbour, after == zOrder.end() ? nullptr : getFigure(after->second));
+    }
+}
+
+void Editor::lower(const std::vector<AbstractFigure*>& figs) {
+    ChangeScope scope(*this);
+    auto sorted = sortedByZ(figs);
+    std::unordered_set<const AbstractFigure*> selected(sorted.begin(), sorted.end());
+    for (AbstractFigure* fig : sorted) {
+        auto pos = zOrder.find(handles.at(fig).z);
+        if (pos == zOrder.begin()) continue;
+        auto prev = std::prev(pos);
+        AbstractFigure* neighbour = getFigure(prev->second);
+        if (selected.count(neighbour)) continue;
+        AbstractFigure* before = prev == zOrder.begin() ? nullptr : getFigure(std::prev(prev)->second);
+        placeBetween(fig, before, neighbour);
+    }
 }
 
 AbstractFigure* Editor::findFigureAt(const sf::Vector2f& point) {
-    for (int i = figureCount - 1; i >= 0; --i) {
-        if (figures[i]->contains(point))
-            return figures[i];
+    const auto& ord = drawOrder();
+    for (size_t i = ord.size(); i-- > 0;) {
+        AbstractFigure* fig = getFigure(ord[i]);
+        if (fig->contains(point))
+            return fig;
     }
     return nullptr;
 }
 
-size_t Editor::getFigureCount() const { return figureCount; }
+size_t Editor::getFigureCount() const { return figures.size(); }
 
 AbstractFigure* Editor::getFigure(size_t index) {
-    return (index < (size_t)figureCount) ? figures[index] : nullptr;
+    const auto& ord = drawOrder();
+    return index < ord.size() ? getFigure(ord[index]) : nullptr;
+}
+
+AbstractFigure* Editor::getFigure(FigureHandle handle) const {
+    auto* slot = figures.get(handle);
+    return slot ? slot->get() : nullptr;
+}
+
+FigureHandle Editor::getHandle(const AbstractFigure* fig) const {
+    auto it = handles.find(fig);
+    return it != handles.end() ? it->second.handle : FigureHandle{};
+}
+
+std::vector<AbstractFigure*> Editor::findOverlapping(const AbstractFigure* fig) const {
+    std::vector<AbstractFigure*> result;
+    if (!fig) return result;
+    FigureStore& store = FigureStore::instance();
+    sf::FloatRect box = fig->getBoundingBox();
+    std::vector<CollisionShape> shapes;
+    for (FigureHandle h : drawOrder()) {
+        AbstractFigure* other = getFigure(h);
+        if (other == fig || !boxesOverlap(box, store.bounds(other->getEntity()))) continue;
+        if (shapes.empty()) collectCollisionShapes(*fig, shapes);
+        std::vector<CollisionShape> otherShapes;
+        collectCollisionShapes(*other, otherShapes);
+        if (shapesIntersect(shapes, otherShapes)) result.push_back(other);
+    }
+    return result;
 }
 
-const AbstractFigure* const* Editor::getFigures() const { return figures; }
+std::vector<std::pair<AbstractFigure*, AbstractFigure*>> Editor::findOverlappingPairs() const {
+    std::vector<std::pair<AbstractFigure*, AbstractFigure*>> result;
+    const auto& ord = drawOrder();
+    size_t n = ord.size();
+
+    std::vector<AbstractFigure*> list(n);
+    std::vector<sf::FloatRect> boxes(n);
+    std::vector<size_t> sorted(n);
+    FigureStore& store = FigureStore::instance();
+    for (size_t i = 0; i < n; ++i) {
+        list[i] = getFigure(ord[i]);
+        boxes[i] = store.bounds(list[i]->getEntity());
+        sorted[i] = i;
+    }
+    std::sort(sorted.begin(), sorted.end(),
+              [&](size_t a, size_t b) { return boxes[a].left < boxes[b].left; });
+
+    // Границы в порядке сортировки лежат отдельными массивами:
+    // внутренний цикл идёт по памяти линейно и без ветвлений
+    std::vector<float> minX(n), maxX(n), minY(n), maxY(n);
+    for (size_t k = 0; k < n; ++k) {
+        const sf::FloatRect& b = boxes[sorted[k]];
+        minX[k] = b.left;
+        maxX[k] = b.left + b.width;
+        minY[k] = b.top;
+        maxY[k] = b.top + b.height;
+    }
+
+    // Формы строим лениво и только для фигур, прошедших отсев по рамкам
+    std::vector<std::vector<CollisionShape>> shapes(n);
+    std::vector<char> ready(n, 0);
+    auto shapesOf = [&](size_t i) -> const std::vector<CollisionShape>& {
+        if (!ready[i]) {
+            collectCollisionShapes(*list[i], shapes[i]);
+            ready[i] = 1;
+        }
+        return shapes[i];
+    };
+
+    std::vector<size_t> candidates;
+    for (size_t a = 0; a < n; ++a) {
+        size_t end = std::upper_bound(minX.begin() + a + 1, minX.end(), maxX[a]) - minX.begin();
+        candidates.resize(end - a);
+        size_t count = 0;
+        float top = minY[a], bottom = maxY[a];
+        for (size_t b = a + 1; b < end; ++b) {
+            candidates[count] = b;
+            count += (minY[b] <= bottom) & (maxY[b] >= top);
+        }
+        for (size_t c = 0; c < count; ++c) {
+            size_t i = sorted[a], j = sorted[candidates[c]];
+            if (shapesIntersect(shapesOf(i), shapesOf(j))) {
+                // Пара в порядке отрисовки: нижняя фигура первой
+                result.push_back({list[std::min(i, j)], list[std::max(i, j)]});
+            }
+        }
+    }
+    return result;
+}
+
+// point задан в координатах сцены; вложенные фигуры переводят его сами по мировым матрицам
+// Рамку самой fig проверил вызывающий; у детей она берётся по мировой матрице
+static void nearestSegmentIn(AbstractFigure* fig, const sf::Vector2f& point, float maxDistance, SegmentHit& hit) {
+    if (auto* comp = figureCast<CompositeFigure>(fig)) {
+        for (size_t i = comp->getChildCount(); i-- > 0;) {
+            float radius = hit.figure ? std::min(maxDistance, hit.distance) : maxDistance;
+            sf::FloatRect probe(point.x - radius, point.y - radius, 2 * radius, 2 * radius);
+            if (boxesOverlap(comp->getChild(i)->getBoundingBox(), probe))
+                nearestSegmentIn(comp->getChild(i), point, radius, hit);
+        }
+        return;
+    }
+    auto* poly = figureCast<PolylineFigure>(fig);
+    if (!poly) return;
+
+    sf::Vector2f local;
+    long side = poly->findNearestSide(point, maxDistance, local);
+    if (side < 0) return;
+    sf::Vector2f d = poly->getWorldTransform().transformPoint(local) - point;
+    float dist = std::sqrt(d.x * d.x + d.y * d.y);
+    if (dist > maxDistance) return;
+    if (!hit.figure || dist < hit.distance)
+        hit = {poly, (size_t)side, local, dist};
+}
+
+SegmentHit Editor::findNearestSegment(const sf::Vector2f& point, float maxDistance) const {
+    SegmentHit hit;
+    // Фигуры верхнего уровня отсеиваются по рамкам из хранилища, без виртуальных вызовов
+    sf::FloatRect probe(point.x - maxDistance, point.y - maxDistance, 2 * maxDistance, 2 * maxDistance);
+    std::vector<EntityId> near;
+    cullTopLevel(probe, near);
+    FigureStore& store = FigureStore::instance();
+    for (size_t i = near.size(); i-- > 0;)
+        nearestSegmentIn(store.owner(near[i]), point, hit.figure ? hit.distance : maxDistance, hit);
+    return hit;
+}
+
+SegmentHit Editor::splitSegmentAt(const sf::Vector2f& point, float maxDistance) {
+    SegmentHit hit = findNearestSegment(point, maxDistance);
+    if (hit.figure) {
+        ChangeScope scope(*this, {hit.figure});
+        hit.figure->insertVertex(hit.side + 1, hit.localPoint);
+    }
+    return hit;
+}
 
 void Editor::handleEvent(sf::Event& event, sf::RenderWindow& window) {
+    // Мышь с частым опросом присылает несколько движений за кадр; фигура двигается
+    // один раз за кадр, а перед любым другим событием догоняет курсор
+    if (event.type == sf::Event::MouseMoved) {
+        if (dragging && selectedFigure) {
+            dragTarget = window.mapPixelToCoords({event.mouseMove.x, event.mouseMove.y}) + dragOffset;
+            dragPending = true;
+        }
+        return;
+    }
+    applyPendingDrag();
+
     if (event.type == sf::Event::MouseButtonPressed &&
         event.mouseButton.button == sf::Mouse::Left) {
         sf::Vector2f mouse = window.mapPixelToCoords({event.mouseButton.x, event.mouseButton.y});
-        selectedFigure = nullptr;
         // Поиск фигуры под курсором
-        for (int i = figureCount - 1; i >= 0; --i) {
-            if (figures[i]->contains(mouse)) {
-                selectedFigure = figures[i];
-                dragOffset = selectedFigure->getPosition() - mouse;
-                dragging = true;
-                break;
-            }
+        selectedFigure = findFigureAt(mouse);
+        if (selectedFigure) {
+            dragOffset = selectedFigure->getPosition() - mouse;
+            // Всё перетаскивание — одна правка до отпускания кнопки
+            if (!dragging) beginChange({selectedFigure});
+            dragging = true;
         }
     }
-    else if (event.type == sf::Event::MouseMoved && dragging && selectedFigure) {
-        sf::Vector2f mouse = window.mapPixelToCoords({event.mouseMove.x, event.mouseMove.y});
-        selectedFigure->setPosition(mouse + dragOffset);
-    }
     else if (event.type == sf::Event::MouseButtonReleased &&
              event.mouseButton.button == sf::Mouse::Left) {
+        if (dragging) endChange();
         dragging = false;
     }
 }
 
+void Editor::applyPendingDrag() {
+    if (!dragPending) return;
+    dragPending = false;
+    if (dragging && selectedFigure) selectedFigure->setPosition(dragTarget);
+}
+
+void Editor::cullTopLevel(const sf::FloatRect& rect, std::vector<EntityId>& out) const {
+    const auto& ord = drawOrder();
+    std::vector<EntityId> entities(ord.size());
+    for (size_t i = 0; i < ord.size(); ++i) entities[i] = getFigure(ord[i])->getEntity();
+    FigureStore::instance().cull(entities.data(), entities.size(), rect, out);
+}
+
 void Editor::draw(sf::RenderWindow& window) {
-    // 1. Рисуем все фигуры из массива
-    for (int i = 0; i < figureCount; ++i) {
-        figures[i]->draw(window);
+    applyPendingDrag();
+    // 1. Рисуем в порядке отрисовки фигуры, попадающие в окно.
+    // Запас нужен под острые стыки толстых сторон, выходящие за рамку
+    const sf::View& view = window.getView();
+    const float margin = 100.f;
+    sf::FloatRect visible(view.getCenter() - view.getSize() / 2.f - sf::Vector2f(margin, margin),
+                          view.getSize() + sf::Vector2f(2 * margin, 2 * margin));
+    std::vector<EntityId> shown;
+    cullTopLevel(visible, shown);
+    FigureStore& store = FigureStore::instance();
+    // Кэши мировых координат обновляются здесь, в одном потоке: сама отрисовка их не пишет
+    for (EntityId id : shown) {
+        AbstractFigure* fig = store.owner(id);
+        fig->refreshWorld();
+        fig->draw(window);
     }
 
     // 2. Рисуем выделение (рамка и пивот)
     if (selectedFigure) {
-        CompositeFigure* parent = nullptr;
-        sf::Vector2f offset(0.f, 0.f);
-
-        // Проверяем, не находится ли selectedFigure внутри группы
-        for (int i = 0; i < figureCount; ++i) {
-            if (auto* comp = dynamic_cast<CompositeFigure*>(figures[i])) {
-                for (size_t j = 0; j < comp->getChildCount(); ++j) {
-                    if (comp->getChild(j) == selectedFigure) {
-                        parent = comp;
-                        offset = comp->getChildOffset(j);
-                        break;
-                    }
-                }
-            }
-            if (parent) break;
-        }
-
-        sf::Vector2f originalPos = selectedFigure->getPosition();
-        if (parent) selectedFigure->setPosition(parent->getPosition() + offset);
-
+        // Рамка и пивот берутся по мировой матрице, в том числе у фигур внутри групп
         sf::FloatRect bounds = selectedFigure->getBoundingBox();
         sf::RectangleShape rect({bounds.width, bounds.height});
         rect.setPosition(bounds.left, bounds.top);
@@ -156,13 +744,12 @@ void Editor::draw(sf::RenderWindow& window) {
         lineV.setPosition(pivotMarker.getPosition());
         lineV.setFillColor(sf::Color::Black);
         window.draw(lineV);
-
-        if (parent) selectedFigure->setPosition(originalPos);
     }
 }
 
 void Editor::handleScale(float delta) {
     if (selectedFigure) {
+        ChangeScope scope(*this, {selectedFigure});
         float newScale = selectedFigure->getScale() * (1.0f + delta * 0.1f);
         if (newScale > 0.1f && newScale < 5.0f)
             selectedFigure->setScale(newScale);
@@ -170,51 +757,161 @@ void Editor::handleScale(float delta) {
 }
 
 void Editor::saveToFile(const std::string& filename) {
-    std::ofstream out(filename);
-    if (!out) return;
-    out << figureCount << '\n';
-    for (int i = 0; i < figureCount; ++i) {
-        figures[i]->serialize(out);
+    if (!SceneBinary::isBinaryName(filename)) {
+        std::ofstream out(filename);
+        if (out) snapshot().save(out);
+        return;
     }
+    // Сцена может ссылаться на отображение этого же файла: обрезать его нельзя.
+    // Пишем рядом и подменяем — старое содержимое живёт, пока открыто отображение
+    std::string temp = filename + ".tmp";
+    {
+        std::ofstream out(temp, std::ios::binary);
+        if (!out) return;
+        SceneBinary::write(snapshot(), out);
+        if (!out.flush()) {
+            out.close();
+            std::remove(temp.c_str());
+            return;
+        }
+    }
+    std::rename(temp.c_str(), filename.c_str());
 }
 
-void Editor::loadFromFile(const std::string& filename) {
-    // Очищаем текущую сцену
-    for (int i = 0; i < figureCount; ++i) delete figures[i];
-    figureCount = 0;
-    selectedFigure = nullptr;
+SceneSnapshot Editor::snapshot() {
+    applyPendingDrag();
+    syncRecords();
+    return SceneSnapshot(records);
+}
+
+void Editor::syncRecords() {
+    FigureStore& store = FigureStore::instance();
+    for (EntityId id : store.takeChanged()) {
+        AbstractFigure* fig = store.owner(id);
+        if (!fig || !inScene(fig)) {
+            records.erase(id);
+            continue;
+        }
+        auto top = handles.find(fig);
+        bool nested = top == handles.end();
+        const auto* previous = records.find(id);
+        records.set(id, FigureRecord::capture(*fig, nested, nested ? 0 : top->second.z,
+                                              previous ? previous->get() : nullptr));
+    }
+}
+
+bool Editor::inScene(const AbstractFigure* fig) const {
+    while (fig->getParent()) fig = fig->getParent();
+    return handles.count(fig) > 0;
+}
 
-    std::ifstream in(filename);
-    if (!in) return;
-    int count;
-    in >> count;
-    for (int i = 0; i < count; ++i) {
-        std::string type;
-        in >> type;   // тип фигуры
-        auto figPtr = FigureManager::instance().create(type);
-        if (figPtr) {
-            figPtr->deserialize(in);
-            addFigure(figPtr.release());  // передаём владение
+void Editor::loadFromFile(const std::string& filename) {
+    // Прежняя сцена уходит в правку загрузки, новые фигуры пишутся туда же
+    beginLoad();
+    if (auto file = MappedFile::open(filename)) {
+        ChangeScope scope(*this);
+        if (SceneBinary::isBinaryName(filename)) {
+            readBinary(file);
         } else {
-            // пропустить строки этой фигуры? Лучше выйти или попытаться пропустить.
-            std::cerr << "Unknown figure type: " << type << std::endl;
-            // Пропускаем до конца фигуры? Сложно, для простоты прерываем загрузку.
-            break;
+            readText(file->data(), file->data() + file->size());
         }
     }
+    endLoad();
 }
 
-std::unique_ptr<AbstractFigure> Editor::extractFigure(AbstractFigure* fig) {
-    for (int i = 0; i < figureCount; ++i) {
-        if (figures[i] == fig) {
-            std::unique_ptr<AbstractFigure> ptr(figures[i]);
-            for (int j = i; j < figureCount - 1; ++j) {
-                figures[j] = figures[j + 1];
+void Editor::reserve(size_t topLevel, size_t allFigures, size_t copiedVertices) {
+    // Загрузка, которая заведомо не поместится в историю, не записывается:
+    // прежняя сцена освобождается сейчас, а не после чтения
+    if (loadOpen) {
+        std::unique_ptr<SceneChange>& load = changeDepth > 0 ? change : loading;
+        if (!load || load->recordedBytes() + allFigures * sizeof(PolylineFigure) > history.getBudget()) {
+            // Новых фигур в сцене ещё нет: clear заодно отдаёт пул прежней сцены
+            if (figures.size() == 0) {
+                clear();
+            } else {
+                history.clear();
+                load.reset();
+                loadOpen = false;
             }
-            figures[--figureCount] = nullptr;
-            if (selectedFigure == fig) selectedFigure = nullptr;
-            return ptr;
         }
     }
-    return nullptr;
+    size_t total = figures.size() + topLevel;
+    if (total > order.capacity()) {
+        figures.reserve(total);
+        handles.reserve(total);
+        order.reserve(total);
+    }
+    FigureStore::instance().reserve(allFigures);
+    SpanPool<sf::Vector2f>::instance().reserveBlocks(allFigures, copiedVertices);
+    SpanPool<float>::instance().reserveBlocks(allFigures, copiedVertices);
+    SpanPool<sf::Color>::instance().reserveBlocks(allFigures, copiedVertices);
+}
+
+void Editor::appendLoaded(std::vector<std::unique_ptr<AbstractFigure>>& figs) {
+    if (figs.empty()) return;
+    beginChange();
+    if (!loadOpen) change.reset();
+    addFigures(figs);
+    endChange();
+}
+
+// Текст разбирает SceneText, как и при фоновой загрузке: пачки двоичных записей
+// сразу читаются в сцену. Разбор останавливается на недочитанной записи или
+// записи неизвестного типа, и уже прочитанные фигуры остаются в сцене
+void Editor::readText(const char* begin, const char* end) {
+    TextReader in(begin, end);
+    uint64_t count;
+    if (!(in >> count)) return;
+    reserve(count, count, 0);
+    std::string unknownType;
+    SceneText::transcode(in, count, SceneText::knownTypes(), [&](std::string&& batch) {
+        SceneReader reader(batch.data(), batch.size(), nullptr);
+        return reader.readHeader() && readFigures(reader);
+    }, &unknownType);
+    if (!unknownType.empty()) std::cerr << "Unknown figure type: " << unknownType << std::endl;
+}
+
+void Editor::readBinary(const std::shared_ptr<const MappedFile>& file) {
+    // Записи разбираются прямо из файла; из отображения геометрия не копируется
+    SceneReader reader(file->data(), file->size(), file->isMapped() ? file : nullptr);
+    if (!reader.readHeader()) {
+        std::cerr << "Unsupported scene file" << std::endl;
+        return;
+    }
+    reserve(reader.figureCount(), reader.totalFigures(), reader.borrowsGeometry() ? 0 : reader.totalVertices());
+    readFigures(reader);
+}
+
+bool Editor::readFigures(SceneReader& reader) {
+    // Фигуры уходят в сцену пачками: ключи порядка и таблицы заполняются подряд
+    const size_t batchSize = 4096;
+    std::vector<std::unique_ptr<AbstractFigure>> batch;
+    batch.reserve(batchSize);
+    bool ok = true;
+    for (uint64_t i = 0; i < reader.figureCount(); ++i) {
+        auto fig = reader.readFigure();
+        // Запись неизвестного типа пропущена; дальше читать нельзя только после повреждения
+        if (!fig) {
+            if (reader.ok()) continue;
+            ok = false;
+            break;
+        }
+        batch.push_back(std::move(fig));
+        if (batch.size() == batchSize) addFigures(batch);
+    }
+    addFigures(batch);
+    return ok;
+}
+
+std::unique_ptr<AbstractFigure> Editor::extractFigure(AbstractFigure* fig) {
+    FigureHandle handle = getHandle(fig);
+    if (!figures.contains(handle)) return nullptr;
+    ChangeScope scope(*this);
+    uint64_t z = handles.at(fig).z;
+    auto owned = take(handle);
+    if (change) {
+        change->detachTop(fig, z, nullptr);
+        checkBudget();
+    }
+    return owned;
 }
\ No newline at end of file
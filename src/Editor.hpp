@@ -2,19 +2,62 @@
 #include "AbstractFigure.hpp"
 #include <SFML/Graphics.hpp>
 #include "FigureManager.hpp"
+#include "SlotMap.hpp"
+#include "FigureArena.hpp"
+#include "History.hpp"
+#include "SceneSnapshot.hpp"
+#include "MappedFile.hpp"
+#include <vector>
+#include <utility>
+#include <memory>
+#include <unordered_map>
+#include <map>
+#include <cstdint>
 
-#define MAX_FIGURES 1000
+// Устойчивый идентификатор фигуры верхнего уровня
+using FigureHandle = SlotHandle;
+
+class CompositeFigure;
+
+// Ближайшая к курсору сторона многоугольника
+struct SegmentHit {
+    AbstractFigure* figure = nullptr;
+    size_t side = 0;            // сторона от вершины side к side+1
+    sf::Vector2f localPoint;    // точка на стороне в локальных координатах фигуры
+    float distance = 0.f;
+};
 
 class Editor {
 public:
     Editor();
     ~Editor();
 
-std::unique_ptr<AbstractFigure> extractFigure(AbstractFigure* fig);
+    // Вынимает фигуру верхнего уровня; в пределах открытой правки её нужно вернуть
+    // в сцену через редактор (например, addToGroup), иначе откат не сможет её найти.
+    // Память фигуры остаётся в пуле сцены: дольше сцены её держать не следует,
+    // для этого есть копия внутри FigureArena::HeapScope
+    std::unique_ptr<AbstractFigure> extractFigure(AbstractFigure* fig);
 
     void handleEvent(sf::Event& event, sf::RenderWindow& window);
+    // Применяет последнее положение перетаскивания, накопленное за кадр;
+    // draw и остальные события вызывают его сами
+    void applyPendingDrag();
     void draw(sf::RenderWindow& window);
-    void addFigure(AbstractFigure* fig);   // принимает владение сырым указателем
+    FigureHandle addFigure(AbstractFigure* fig);   // принимает владение сырым указателем
+    // Кладёт фигуры поверх сцены по порядку одним проходом, без поиска мест для ключей
+    void addFigures(std::vector<std::unique_ptr<AbstractFigure>>& figs);
+    // То же для загружаемой сцены: пишется в правку загрузки, если она открыта.
+    // Только вне открытой правки
+    void appendLoaded(std::vector<std::unique_ptr<AbstractFigure>>& figs);
+    // Загрузка сцены — одна правка: beginLoad убирает прежние фигуры в неё, endLoad
+    // кладёт её в историю, и один undo возвращает прежнюю сцену. Правки между ними
+    // входят в ту же команду, undo и redo до endLoad не работают. Если прежняя
+    // сцена не помещается в бюджет истории, она просто очищается вместе с историей
+    void beginLoad();
+    void endLoad();
+    // Место под загружаемую сцену сразу: таблицы редактора, хранилище фигур и пулы
+    // геометрии не переезжают по ходу загрузки. copiedVertices — вершин, копируемых в пулы
+    void reserve(size_t topLevel, size_t allFigures, size_t copiedVertices);
     void removeSelected();
     AbstractFigure* getSelected() const;
     void setSelected(AbstractFigure* fig);
@@ -23,17 +66,147 @@ std::unique_ptr<AbstractFigure> extractFigure(AbstractFigure* fig);
 
     AbstractFigure* findFigureAt(const sf::Vector2f& point);
     bool removeFigure(AbstractFigure* fig);
+    bool removeFigure(FigureHandle handle);
+    void clear();
     size_t getFigureCount() const;
-    AbstractFigure* getFigure(size_t index);
-    const AbstractFigure* const* getFigures() const;   // для доступа к массиву
+    AbstractFigure* getFigure(size_t index);            // по порядку отрисовки
+    AbstractFigure* getFigure(FigureHandle handle) const;
+    FigureHandle getHandle(const AbstractFigure* fig) const;
+
+    // Группа, в которой лежит fig (nullptr для фигур верхнего уровня), и индекс в ней
+    CompositeFigure* findParent(const AbstractFigure* fig, size_t* index = nullptr) const;
+    // Позиция, на которой фигура рисуется с учётом всех групп над ней
+    sf::Vector2f getDrawPosition(const AbstractFigure* fig) const;
+    // Вынимает фигуру из её группы, владение переходит к вызывающему
+    std::unique_ptr<AbstractFigure> extractFromGroup(AbstractFigure* child);
+
+    // Порядок отрисовки для фигур верхнего уровня (вложенные пропускаются).
+    // Набор сохраняет взаимный порядок; каждая фигура переставляется за O(log n)
+    void bringToFront(const std::vector<AbstractFigure*>& figs);
+    void sendToBack(const std::vector<AbstractFigure*>& figs);
+    // На одну позицию выше/ниже соседа, не входящего в набор
+    void raise(const std::vector<AbstractFigure*>& figs);
+    void lower(const std::vector<AbstractFigure*>& figs);
 
+    // Фигуры сцены, пересекающиеся с fig
+    std::vector<AbstractFigure*> findOverlapping(const AbstractFigure* fig) const;
+    // Все пересекающиеся пары: sweep-and-prune по рамкам, затем точная проверка
+    std::vector<std::pair<AbstractFigure*, AbstractFigure*>> findOverlappingPairs() const;
+
+    SegmentHit findNearestSegment(const sf::Vector2f& point, float maxDistance) const;
+    // Делит ближайшую сторону новой вершиной; figure == nullptr, если делить нечего
+    SegmentHit splitSegmentAt(const sf::Vector2f& point, float maxDistance);
+
+    // Формат выбирается по расширению: .spb — двоичный, остальные — текстовый
     void saveToFile(const std::string& filename);
+    // Неизменяемый снимок сцены для чтения из другого потока. Стоит O(число фигур,
+    // изменённых с прошлого снимка); у соседних снимков общие неизменённые записи
+    SceneSnapshot snapshot();
+    // Файл отображается в память. Геометрия фигур из двоичного файла ссылается
+    // на него и копируется только при первой правке. Откатывается одним undo
     void loadFromFile(const std::string& filename);
 
+    // Правка для истории: всё, что сделано между beginChange и endChange, откатывается
+    // одним undo. Вызовы вкладываются; записывается внешняя пара. figs — фигуры,
+    // которые будут меняться в обход редактора (их свойства запоминаются заранее).
+    // Структурные методы редактора открывают правку сами, если она не открыта
+    void beginChange(const std::vector<AbstractFigure*>& figs = {});
+    // Добавляет фигуры к открытой правке. Зовётся прямо перед правкой в обход
+    // редактора, чтобы событие, которое ничего не меняет, ничего и не запоминало
+    void touch(AbstractFigure* fig);
+    void touch(const std::vector<AbstractFigure*>& figs);
+    void endChange();
+    bool isChanging() const { return changeDepth > 0; }
+    // Только вне открытой правки
+    bool undo();
+    bool redo();
+    History& getHistory() { return history; }
+
+    class ChangeScope {
+    public:
+        explicit ChangeScope(Editor& editor, const std::vector<AbstractFigure*>& figs = {})
+            : editor(editor) { editor.beginChange(figs); }
+        ~ChangeScope() { editor.endChange(); }
+        ChangeScope(const ChangeScope&) = delete;
+        ChangeScope& operator=(const ChangeScope&) = delete;
+    private:
+        Editor& editor;
+    };
+
+    // Кладёт фигуру в группу на место offset
+    void addToGroup(CompositeFigure* group, std::unique_ptr<AbstractFigure> fig, const sf::Vector2f& offset);
+
 private:
-    AbstractFigure* figures[MAX_FIGURES];
-    int figureCount = 0;
+    friend class SceneChange;
+
+    // Примитивы без записи в историю; через них же история откатывает правки
+    FigureHandle attachAt(std::unique_ptr<AbstractFigure> fig, uint64_t z);
+    std::unique_ptr<AbstractFigure> detachTop(AbstractFigure* fig);
+    void attachToGroup(CompositeFigure* group, size_t index, std::unique_ptr<AbstractFigure> fig,
+                       const sf::Vector2f& offset);
+    std::unique_ptr<AbstractFigure> detachFromGroup(CompositeFigure* group, size_t index);
+    // Ставит фигуре ключ z (или ближайший свободный выше) и возвращает прежний
+    uint64_t setZ(AbstractFigure* fig, uint64_t z);
+    // Правка превысила бюджет истории: история сбрасывается, правка дальше не пишется
+    void checkBudget();
+
+    std::unique_ptr<AbstractFigure> take(FigureHandle handle);
+    // Фигуры верхнего уровня, чьи рамки из хранилища задевают rect, в порядке отрисовки
+    void cullTopLevel(const sf::FloatRect& rect, std::vector<EntityId>& out) const;
+    const std::vector<FigureHandle>& drawOrder() const;
+    void linkChildren(AbstractFigure* fig);
+    void unlinkSubtree(AbstractFigure* fig);
+    std::vector<AbstractFigure*> sortedByZ(const std::vector<AbstractFigure*>& figs) const;
+    // Ставит fig между below и above (nullptr — край); при нехватке ключей перенумеровывает
+    void placeBetween(AbstractFigure* fig, const AbstractFigure* below, const AbstractFigure* above);
+    void renumber();
+    void readText(const char* begin, const char* end);
+    void readBinary(const std::shared_ptr<const MappedFile>& file);
+    // Добавляет в сцену фигуры верхнего уровня из reader; false — запись повреждена
+    bool readFigures(SceneReader& reader);
+    // Переносит в records изменения, накопленные FigureStore с прошлого раза
+    void syncRecords();
+    // Лежит ли фигура в сцене (сама или внутри группы верхнего уровня)
+    bool inScene(const AbstractFigure* fig) const;
+
+    struct ParentLink {
+        CompositeFigure* parent;
+        size_t index;
+    };
+
+    // Пул памяти сцены; его время жизни управляется через retire()
+    FigureArena* arena;
+    struct Placement {
+        FigureHandle handle;
+        uint64_t z;
+    };
+
+    SlotMap<std::unique_ptr<AbstractFigure>> figures;
+    std::unordered_map<const AbstractFigure*, Placement> handles;
+    // Порядок отрисовки — дробные ключи с запасом между соседями:
+    // перестановка занимает новый ключ между соседями без сдвига остальных
+    std::map<uint64_t, FigureHandle> zOrder;
+    // Плоский порядок для обходов; пересобирается после перестановок
+    mutable std::vector<FigureHandle> order;
+    mutable bool orderDirty = false;
+    // ребёнок -> группа; обновляется в addFigure/extractFigure/removeFigure
+    mutable std::unordered_map<const AbstractFigure*, ParentLink> parents;
     AbstractFigure* selectedFigure = nullptr;
     sf::Vector2f dragOffset;
     bool dragging = false;
+    // Движения мыши за кадр сливаются: запоминается только последняя цель
+    sf::Vector2f dragTarget;
+    bool dragPending = false;
+
+    History history;
+    // Открытая правка; nullptr при открытой правке — запись отключена
+    std::unique_ptr<SceneChange> change;
+    int changeDepth = 0;
+    // Правка идущей загрузки между событиями; внутри правки она лежит в change.
+    // loadOpen сбрасывается, если загрузка перестала писаться (вышла за бюджет)
+    std::unique_ptr<SceneChange> loading;
+    bool loadOpen = false;
+
+    // Записи для снимков по номеру сущности; снимок делит их с редактором
+    RecordMap records;
 };
\ No newline at end of file
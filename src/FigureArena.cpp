@@ -0,0 +1,41 @@
+#include "FigureArena.hpp"
+
+static FigureArena* currentArena = nullptr;
+
+FigureArena::FigureArena() : pool(std::pmr::new_delete_resource()) {}
+
+FigureArena* FigureArena::current() { return currentArena; }
+
+void FigureArena::setCurrent(FigureArena* arena) { currentArena = arena; }
+
+std::pmr::memory_resource* FigureArena::currentResource() {
+    return currentArena ? static_cast<std::pmr::memory_resource*>(currentArena)
+                        : std::pmr::new_delete_resource();
+}
+
+bool FigureArena::release() {
+    if (live != 0) return false;
+    pool.release();
+    return true;
+}
+
+void FigureArena::retire() {
+    if (currentArena == this) currentArena = nullptr;
+    retired = true;
+    if (live == 0) delete this;
+}
+
+void* FigureArena::do_allocate(size_t bytes, size_t alignment) {
+    void* p = pool.allocate(bytes, alignment);
+    ++live;
+    return p;
+}
+
+void FigureArena::do_deallocate(void* p, size_t bytes, size_t alignment) {
+    pool.deallocate(p, bytes, alignment);
+    if (--live == 0 && retired) delete this;
+}
+
+bool FigureArena::do_is_equal(const std::pmr::memory_resource& other) const noexcept {
+    return this == &other;
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <memory_resource>
+#include <cstddef>
+
+// Пул памяти сцены: объекты фигур (через AbstractFigure::operator new) берут
+// память отсюда, а не по одному new на объект. Геометрия лежит в SpanPool.
+// Пока в пуле нет живых блоков, всё освобождается одним release().
+// Фигуры, которые живут дольше сцены (прототипы), создаются в обычной куче
+// внутри HeapScope: иначе пул со всеми кусками памяти сцены жил бы вместе с ними.
+// Пул, у которого всё же остались живые блоки, после retire() удаляет себя сам,
+// когда освобождается последний блок.
+class FigureArena : public std::pmr::memory_resource {
+public:
+    FigureArena();
+    FigureArena(const FigureArena&) = delete;
+    FigureArena& operator=(const FigureArena&) = delete;
+
+    // Пул, из которого сейчас создаются фигуры; nullptr — обычная куча
+    static FigureArena* current();
+    static void setCurrent(FigureArena* arena);
+    // Ресурс для новых фигур: текущий пул или куча
+    static std::pmr::memory_resource* currentResource();
+
+    // Пока объект жив, фигуры создаются в обычной куче
+    class HeapScope {
+    public:
+        HeapScope() : saved(current()) { setCurrent(nullptr); }
+        ~HeapScope() { setCurrent(saved); }
+        HeapScope(const HeapScope&) = delete;
+        HeapScope& operator=(const HeapScope&) = delete;
+    private:
+        FigureArena* saved;
+    };
+
+    size_t liveBlocks() const { return live; }
+    // Освобождает все блоки разом; допустимо только без живых блоков
+    bool release();
+    // Владелец отказывается от пула
+    void retire();
+
+private:
+    ~FigureArena() override = default;
+
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+
+    std::pmr::unsynchronized_pool_resource pool;
+    size_t live = 0;
+    bool retired = false;
+};
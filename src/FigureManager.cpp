@@ -10,6 +10,11 @@ void FigureManager::registerFactory(const std::string& name, Factory factory) {
 }
 
 void FigureManager::registerPrototype(const std::string& name, std::unique_ptr<AbstractFigure> prototype) {
+    // Прототип живёт до конца программы: его копия берёт память из кучи, а не из пула сцены
+    {
+        FigureArena::HeapScope heap;
+        prototype = prototype->clone();
+    }
     entries[name] = {Entry::PROTOTYPE, nullptr, std::move(prototype)};
 }
 
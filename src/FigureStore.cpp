@@ -0,0 +1,171 @@
+#include "FigureStore.hpp"
+#include "AbstractFigure.hpp"
+#include <algorithm>
+#include <cmath>
+
+FigureStore& FigureStore::instance() {
+    // Не разрушается при выходе: прототипы в FigureManager живут до самого конца
+    static FigureStore* store = new FigureStore();
+    return *store;
+}
+
+EntityId FigureStore::create(AbstractFigure* figure) {
+    EntityId id;
+    if (!freeIds.empty()) {
+        id = freeIds.back();
+        freeIds.pop_back();
+    } else {
+        id = (EntityId)owners.size();
+        posX.push_back(0); posY.push_back(0);
+        scalesX.push_back(1.f); scalesY.push_back(1.f); rotations.push_back(0);
+        worlds.emplace_back(); worldStamps.push_back(0); parentStamps.push_back(0);
+        boxMinX.push_back(0); boxMinY.push_back(0); boxMaxX.push_back(0); boxMaxY.push_back(0);
+        fillColors.push_back(0); flags.push_back(0);
+        typeNames.push_back(0); customNames.push_back(0);
+        owners.push_back(nullptr);
+    }
+    posX[id] = posY[id] = 0;
+    scalesX[id] = scalesY[id] = 1.f;
+    rotations[id] = 0;
+    fillColors[id] = sf::Color::White.toInteger();
+    flags[id] = Alive | BoundsDirty | TransformDirty | (flags[id] & Changed);
+    markChanged(id);
+    static const Symbol defaultType = SymbolTable::instance().intern("Figure");
+    typeNames[id] = defaultType;
+    customNames[id] = 0;
+    owners[id] = figure;
+    return id;
+}
+
+void FigureStore::reserve(size_t extra) {
+    size_t n = owners.size() + extra;
+    for (auto* v : {&posX, &posY, &scalesX, &scalesY, &rotations, &boxMinX, &boxMinY, &boxMaxX, &boxMaxY})
+        v->reserve(n);
+    worlds.reserve(n);
+    worldStamps.reserve(n);
+    parentStamps.reserve(n);
+    fillColors.reserve(n);
+    flags.reserve(n);
+    typeNames.reserve(n);
+    customNames.reserve(n);
+    owners.reserve(n);
+}
+
+void FigureStore::destroy(EntityId id) {
+    markChanged(id);
+    flags[id] = Changed;
+    owners[id] = nullptr;
+    freeIds.push_back(id);
+}
+
+std::vector<EntityId> FigureStore::takeChanged() {
+    std::vector<EntityId> result;
+    result.swap(changed);
+    for (EntityId id : result) flags[id] &= ~Changed;
+    return result;
+}
+
+void FigureStore::setWorld(EntityId id, const sf::Transform& t, uint64_t parentStamp) {
+    worlds[id] = t;
+    worldStamps[id] = ++lastStamp;
+    parentStamps[id] = parentStamp;
+    flags[id] &= ~TransformDirty;
+}
+
+void FigureStore::updateBounds(EntityId id) {
+    sf::FloatRect box = owners[id]->getBoundingBox();
+    boxMinX[id] = box.left - posX[id];
+    boxMinY[id] = box.top - posY[id];
+    boxMaxX[id] = boxMinX[id] + box.width;
+    boxMaxY[id] = boxMinY[id] + box.height;
+    flags[id] &= ~BoundsDirty;
+}
+
+sf::FloatRect FigureStore::bounds(EntityId id) {
+    if (flags[id] & BoundsDirty) updateBounds(id);
+    return {posX[id] + boxMinX[id], posY[id] + boxMinY[id],
+            boxMaxX[id] - boxMinX[id], boxMaxY[id] - boxMinY[id]};
+}
+
+void FigureStore::refreshBounds() {
+    for (EntityId id = 0; id < owners.size(); ++id) {
+        if ((flags[id] & (Alive | BoundsDirty)) == (Alive | BoundsDirty)) updateBounds(id);
+    }
+}
+
+// Группы обновляют своих потомков сами, поэтому проход идёт по фигурам верхнего уровня
+void FigureStore::refreshWorld() {
+    for (EntityId id = 0; id < owners.size(); ++id) {
+        if ((flags[id] & Alive) && !owners[id]->getParent()) owners[id]->refreshWorld();
+    }
+}
+
+void FigureStore::translate(const EntityId* ids, size_t count, sf::Vector2f offset) {
+    for (size_t i = 0; i < count; ++i) {
+        posX[ids[i]] += offset.x;
+        posY[ids[i]] += offset.y;
+        flags[ids[i]] |= TransformDirty;
+    }
+}
+
+void FigureStore::scaleAbout(const EntityId* ids, size_t count, sf::Vector2f pivot, float factor) {
+    for (size_t i = 0; i < count; ++i) {
+        EntityId id = ids[i];
+        posX[id] = pivot.x + (posX[id] - pivot.x) * factor;
+        posY[id] = pivot.y + (posY[id] - pivot.y) * factor;
+        scalesX[id] *= factor;
+        scalesY[id] *= factor;
+        flags[id] |= BoundsDirty | TransformDirty;
+    }
+}
+
+void FigureStore::rotate(const EntityId* ids, size_t count, float degrees) {
+    for (size_t i = 0; i < count; ++i) {
+        EntityId id = ids[i];
+        rotations[id] = std::fmod(rotations[id] + degrees, 360.f);
+        flags[id] |= BoundsDirty | TransformDirty;
+    }
+}
+
+void FigureStore::setFill(const EntityId* ids, size_t count, sf::Color color, bool filled) {
+    uint32_t packed = color.toInteger();
+    for (size_t i = 0; i < count; ++i) {
+        EntityId id = ids[i];
+        fillColors[id] = packed;
+        flags[id] = filled ? (flags[id] | Filled) : (flags[id] & ~Filled);
+    }
+}
+
+sf::FloatRect FigureStore::unionBounds(const EntityId* ids, size_t count) {
+    if (count == 0) return {};
+    float minX = INFINITY, minY = INFINITY, maxX = -INFINITY, maxY = -INFINITY;
+    for (size_t i = 0; i < count; ++i) {
+        EntityId id = ids[i];
+        if (flags[id] & BoundsDirty) updateBounds(id);
+        minX = std::min(minX, posX[id] + boxMinX[id]);
+        minY = std::min(minY, posY[id] + boxMinY[id]);
+        maxX = std::max(maxX, posX[id] + boxMaxX[id]);
+        maxY = std::max(maxY, posY[id] + boxMaxY[id]);
+    }
+    return {minX, minY, maxX - minX, maxY - minY};
+}
+
+void FigureStore::cull(const EntityId* ids, size_t count, const sf::FloatRect& rect,
+                       std::vector<EntityId>& out) {
+    for (size_t i = 0; i < count; ++i) {
+        if (flags[ids[i]] & BoundsDirty) updateBounds(ids[i]);
+    }
+    float right = rect.left + rect.width;
+    float bottom = rect.top + rect.height;
+    out.resize(count);
+    size_t kept = 0;
+    for (size_t i = 0; i < count; ++i) {
+        EntityId id = ids[i];
+        float x = posX[id], y = posY[id];
+        bool visible = (x + boxMinX[id] <= right) & (x + boxMaxX[id] >= rect.left) &
+                       (y + boxMinY[id] <= bottom) & (y + boxMaxY[id] >= rect.top);
+        out[kept] = id;
+        kept += visible;
+    }
+    out.resize(kept);
+}
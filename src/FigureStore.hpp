@@ -0,0 +1,111 @@
+#pragma once
+#include <SFML/Graphics.hpp>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include "SymbolTable.hpp"
+
+class AbstractFigure;
+
+using EntityId = uint32_t;
+
+// Хранилище компонентов фигур: каждое поле лежит в своём непрерывном массиве,
+// индексом служит EntityId фигуры. AbstractFigure остаётся фасадом над этими данными,
+// а массовые проходы (отсечение, границы, перенос выделения) идут по массивам линейно.
+class FigureStore {
+public:
+    static FigureStore& instance();
+
+    EntityId create(AbstractFigure* owner);
+    // Место ещё под extra записей: пакетная загрузка не перевыделяет массивы по ходу
+    void reserve(size_t extra);
+    void destroy(EntityId id);
+    AbstractFigure* owner(EntityId id) const { return owners[id]; }
+
+    // Трансформ; любая правка помечает мировую матрицу устаревшей
+    sf::Vector2f position(EntityId id) const { return {posX[id], posY[id]}; }
+    void setPosition(EntityId id, sf::Vector2f p) { posX[id] = p.x; posY[id] = p.y; flags[id] |= TransformDirty; markChanged(id); }
+    sf::Vector2f scale(EntityId id) const { return {scalesX[id], scalesY[id]}; }
+    void setScale(EntityId id, sf::Vector2f s) { scalesX[id] = s.x; scalesY[id] = s.y; flags[id] |= TransformDirty; markChanged(id); }
+    float rotation(EntityId id) const { return rotations[id]; }
+    void setRotation(EntityId id, float degrees) { rotations[id] = degrees; flags[id] |= TransformDirty; markChanged(id); }
+    void invalidateTransform(EntityId id) { flags[id] |= TransformDirty; markChanged(id); }
+
+    // Кэш мировой матрицы. Каждый пересчёт получает новую метку; запись верна,
+    // пока фигура не менялась и метка родителя совпадает с запомненной
+    bool worldValid(EntityId id, uint64_t parentStamp) const {
+        return !(flags[id] & TransformDirty) && parentStamps[id] == parentStamp;
+    }
+    const sf::Transform& world(EntityId id) const { return worlds[id]; }
+    uint64_t worldStamp(EntityId id) const { return worldStamps[id]; }
+    void setWorld(EntityId id, const sf::Transform& t, uint64_t parentStamp);
+
+    // Стиль
+    sf::Color fillColor(EntityId id) const { return sf::Color(fillColors[id]); }
+    void setFillColor(EntityId id, sf::Color c) { fillColors[id] = c.toInteger(); markChanged(id); }
+    bool filled(EntityId id) const { return flags[id] & Filled; }
+    void setFilled(EntityId id, bool f) { flags[id] = f ? (flags[id] | Filled) : (flags[id] & ~Filled); markChanged(id); }
+
+    // Имена — номера в SymbolTable
+    Symbol typeName(EntityId id) const { return typeNames[id]; }
+    void setTypeName(EntityId id, Symbol name) { typeNames[id] = name; markChanged(id); }
+    Symbol customName(EntityId id) const { return customNames[id]; }
+    void setCustomName(EntityId id, Symbol name) { customNames[id] = name; markChanged(id); }
+
+    // Границы хранятся относительно позиции: перенос фигуры их не портит
+    void invalidateBounds(EntityId id) { flags[id] |= BoundsDirty; markChanged(id); }
+
+    // Журнал изменённых фигур для снимков сцены: каждая правка фигуры (в том числе
+    // создание и удаление) заносит её номер один раз до следующего takeChanged
+    void markChanged(EntityId id) {
+        if (flags[id] & Changed) return;
+        flags[id] |= Changed;
+        changed.push_back(id);
+    }
+    void markChanged(const EntityId* ids, size_t count) {
+        for (size_t i = 0; i < count; ++i) markChanged(ids[i]);
+    }
+    // Забирает журнал и начинает новый
+    std::vector<EntityId> takeChanged();
+    sf::FloatRect bounds(EntityId id);
+    // Пересчитывает все устаревшие границы одним проходом
+    void refreshBounds();
+    // Обновляет кэши мировых координат всех фигур, вложенных тоже (AbstractFigure::refreshWorld).
+    // Вместе с refreshBounds — подготовка к обходу сцены из нескольких потоков:
+    // после них отрисовка, попадания и рамки только читают, пока фигуры не правят
+    void refreshWorld();
+
+    // Групповые правки одним проходом по массивам; разные ids можно
+    // обрабатывать из разных потоков. Журнал изменений они не ведут:
+    // вызывающий отмечает набор одним markChanged из своего потока
+    void translate(const EntityId* ids, size_t count, sf::Vector2f offset);
+    void scaleAbout(const EntityId* ids, size_t count, sf::Vector2f pivot, float factor);
+    // Поворот каждой фигуры вокруг её собственного пивота
+    void rotate(const EntityId* ids, size_t count, float degrees);
+    void setFill(const EntityId* ids, size_t count, sf::Color color, bool filled);
+    // Общая рамка набора; пустая рамка для пустого набора
+    sf::FloatRect unionBounds(const EntityId* ids, size_t count);
+    // Отбирает из ids фигуры, чьи рамки пересекают rect; порядок сохраняется
+    void cull(const EntityId* ids, size_t count, const sf::FloatRect& rect,
+              std::vector<EntityId>& out);
+
+    size_t size() const { return owners.size() - freeIds.size(); }
+
+private:
+    FigureStore() = default;
+    void updateBounds(EntityId id);
+
+    enum Flag : uint8_t { Alive = 1, Filled = 2, BoundsDirty = 4, TransformDirty = 8, Changed = 16 };
+
+    std::vector<float> posX, posY, scalesX, scalesY, rotations;
+    std::vector<sf::Transform> worlds;
+    std::vector<uint64_t> worldStamps, parentStamps;
+    uint64_t lastStamp = 0;
+    std::vector<float> boxMinX, boxMinY, boxMaxX, boxMaxY;
+    std::vector<uint32_t> fillColors;
+    std::vector<uint8_t> flags;
+    std::vector<Symbol> typeNames, customNames;
+    std::vector<AbstractFigure*> owners;
+    std::vector<EntityId> freeIds;
+    std::vector<EntityId> changed;
+};
@@ -0,0 +1,26 @@
+#pragma once
+#include "PolylineFigure.hpp"
+#include "Circle.hpp"
+#include "CompositeFigure.hpp"
+
+// Вызов visitor с фигурой, приведённой к её встроенному виду (переход по тегу).
+// Фигуры вида Other передаются как AbstractFigure&
+template <typename Visitor>
+decltype(auto) visitFigure(AbstractFigure& fig, Visitor&& visitor) {
+    switch (fig.getKind()) {
+        case FigureKind::Polyline: return visitor(static_cast<PolylineFigure&>(fig));
+        case FigureKind::Circle: return visitor(static_cast<Circle&>(fig));
+        case FigureKind::Composite: return visitor(static_cast<CompositeFigure&>(fig));
+        default: return visitor(fig);
+    }
+}
+
+template <typename Visitor>
+decltype(auto) visitFigure(const AbstractFigure& fig, Visitor&& visitor) {
+    switch (fig.getKind()) {
+        case FigureKind::Polyline: return visitor(static_cast<const PolylineFigure&>(fig));
+        case FigureKind::Circle: return visitor(static_cast<const Circle&>(fig));
+        case FigureKind::Composite: return visitor(static_cast<const CompositeFigure&>(fig));
+        default: return visitor(fig);
+    }
+}
@@ -0,0 +1,298 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <iterator>
+#include <initializer_list>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+// Общий буфер геометрии: данные всех фигур лежат в одном большом массиве,
+// фигура хранит только номер блока (смещение, длина, вместимость).
+// Копии массива разделяют блок по счётчику ссылок; первая запись отделяет копию.
+// Освободившиеся места собираются уплотнением, когда мусора становится больше живых данных.
+// Блок может ссылаться на чужую память (отображённый файл): он только читается,
+// а первая запись копирует его в буфер. Владелец памяти живёт, пока на неё есть блоки.
+// Указатели на данные действительны только до следующего изменяющего вызова пула.
+template <typename T>
+class SpanPool {
+public:
+    static constexpr uint32_t NoBlock = UINT32_MAX;
+
+    static SpanPool& instance() {
+        // Не разрушается при выходе: фигуры-прототипы живут до самого конца
+        static SpanPool* pool = new SpanPool();
+        return *pool;
+    }
+
+    uint32_t allocate(size_t n) {
+        uint32_t id = newBlock();
+        size_t capacity = std::max<size_t>(n, 4);
+        Block& b = blocks[id];
+        b.offset = buffer.size();
+        b.size = n;
+        b.capacity = capacity;
+        b.refs = 1;
+        buffer.resize(buffer.size() + capacity);
+        return id;
+    }
+
+    // Блок из n элементов по адресу values без копирования; owner держит память
+    uint32_t borrow(const T* values, size_t n, const std::shared_ptr<const void>& owner) {
+        // Владельцев мало, а блоки одного файла идут подряд: сначала сравниваем с последним
+        if (owners.empty() || owners[lastOwner].keep != owner) {
+            auto found = std::find_if(owners.begin(), owners.end(), [&](const Owner& o) { return o.keep == owner; });
+            if (found == owners.end())
+                found = std::find_if(owners.begin(), owners.end(), [](const Owner& o) { return !o.keep; });
+            if (found == owners.end()) found = owners.insert(owners.end(), Owner());
+            found->keep = owner;
+            lastOwner = uint32_t(found - owners.begin());
+        }
+        ++owners[lastOwner].blocks;
+        uint32_t id = newBlock();
+        Block& b = blocks[id];
+        b.external = values;
+        b.owner = lastOwner;
+        b.offset = b.capacity = 0;
+        b.size = n;
+        b.refs = 1;
+        return id;
+    }
+
+    // Место ещё под blockCount блоков и elementCount элементов (не меньше минимальной
+    // вместимости блока): пакетная загрузка не переносит буфер по ходу
+    void reserveBlocks(size_t blockCount, size_t elementCount) {
+        blocks.reserve(blocks.size() + blockCount);
+        buffer.reserve(buffer.size() + std::max(elementCount, blockCount * 4));
+    }
+
+    void retain(uint32_t id) { ++blocks[id].refs; }
+
+    void release(uint32_t id) {
+        Block& b = blocks[id];
+        if (--b.refs > 0) return;
+        if (b.external) {
+            b.external = nullptr;
+            Owner& o = owners[b.owner];
+            if (--o.blocks == 0) o.keep.reset();
+        }
+        // Блок в конце буфера просто отрезается: так уходят временные массивы,
+        // которые фигура заменяет сразу после создания
+        if (b.offset + b.capacity == buffer.size()) buffer.resize(b.offset);
+        else garbage += b.capacity;
+        b.capacity = b.size = 0;
+        freeBlocks.push_back(id);
+        if (needsCompaction()) compact();
+    }
+
+    size_t size(uint32_t id) const { return blocks[id].size; }
+    const T* data(uint32_t id) const {
+        const Block& b = blocks[id];
+        return b.external ? b.external : buffer.data() + b.offset;
+    }
+
+    // Изменяемые данные; разделяемый или чужой блок сначала копируется
+    T* mutableData(uint32_t& id) {
+        if (blocks[id].refs > 1 || blocks[id].external) detach(id);
+        return buffer.data() + blocks[id].offset;
+    }
+
+    uint32_t copy(uint32_t id) {
+        size_t n = blocks[id].size;
+        uint32_t result = allocate(n);
+        std::copy_n(data(id), n, buffer.begin() + blocks[result].offset);
+        return result;
+    }
+
+    void resize(uint32_t& id, size_t n) {
+        if (blocks[id].refs > 1 || blocks[id].external) detach(id);
+        reserve(id, n);
+        Block& b = blocks[id];
+        if (n > b.size) std::fill_n(buffer.begin() + b.offset + b.size, n - b.size, T());
+        b.size = n;
+    }
+
+    void insert(uint32_t& id, size_t index, T value) {
+        resize(id, blocks[id].size + 1);
+        Block& b = blocks[id];
+        auto first = buffer.begin() + b.offset;
+        std::move_backward(first + index, first + b.size - 1, first + b.size);
+        first[index] = value;
+    }
+
+    void erase(uint32_t& id, size_t index) {
+        T* p = mutableData(id);
+        Block& b = blocks[id];
+        std::move(p + index + 1, p + b.size, p + index);
+        --b.size;
+    }
+
+    // Сдвигает живые блоки к началу буфера, убирая дыры
+    void compact() {
+        std::vector<uint32_t> live;
+        for (uint32_t i = 0; i < blocks.size(); ++i) {
+            if (blocks[i].refs > 0 && !blocks[i].external) live.push_back(i);
+        }
+        std::sort(live.begin(), live.end(),
+                  [&](uint32_t a, uint32_t b) { return blocks[a].offset < blocks[b].offset; });
+        size_t end = 0;
+        for (uint32_t i : live) {
+            Block& b = blocks[i];
+            if (b.offset != end) {
+                std::move(buffer.begin() + b.offset, buffer.begin() + b.offset + b.size, buffer.begin() + end);
+                b.offset = end;
+            }
+            end += b.capacity;
+        }
+        buffer.resize(end);
+        garbage = 0;
+    }
+
+    size_t bufferSize() const { return buffer.size(); }
+    size_t garbageSize() const { return garbage; }
+
+private:
+    struct Block {
+        size_t offset = 0;
+        size_t size = 0;
+        size_t capacity = 0;
+        const T* external = nullptr;   // данные вне буфера, только для чтения
+        uint32_t refs = 0;
+        uint32_t owner = 0;            // номер в owners для внешнего блока
+    };
+
+    struct Owner {
+        std::shared_ptr<const void> keep;
+        size_t blocks = 0;
+    };
+
+    uint32_t newBlock() {
+        if (!freeBlocks.empty()) {
+            uint32_t id = freeBlocks.back();
+            freeBlocks.pop_back();
+            return id;
+        }
+        blocks.emplace_back();
+        return uint32_t(blocks.size() - 1);
+    }
+
+    void detach(uint32_t& id) {
+        uint32_t own = copy(id);
+        release(id);
+        id = own;
+    }
+
+    // Блок в конце буфера растёт на месте, остальные переезжают в конец
+    void reserve(uint32_t id, size_t n) {
+        Block& b = blocks[id];
+        if (n <= b.capacity) return;
+        size_t capacity = std::max(n, b.capacity * 2);
+        if (b.offset + b.capacity == buffer.size()) {
+            buffer.resize(b.offset + capacity);
+            b.capacity = capacity;
+            return;
+        }
+        size_t offset = buffer.size();
+        buffer.resize(offset + capacity);
+        std::copy_n(buffer.begin() + b.offset, b.size, buffer.begin() + offset);
+        garbage += b.capacity;
+        b.offset = offset;
+        b.capacity = capacity;
+        if (needsCompaction()) compact();
+    }
+
+    // Уплотнение проходит все блоки, поэтому мусора должно набраться не меньше,
+    // чем блоков: иначе при малом буфере и множестве чужих блоков оно шло бы слишком часто
+    bool needsCompaction() const {
+        return garbage > 4096 && garbage > buffer.size() / 2 && garbage > blocks.size();
+    }
+
+    std::vector<T> buffer;
+    std::vector<Block> blocks;
+    std::vector<uint32_t> freeBlocks;
+    std::vector<Owner> owners;
+    uint32_t lastOwner = 0;
+    size_t garbage = 0;
+};
+
+// Массив фигуры в общем пуле: по интерфейсу похож на std::vector,
+// но хранит только номер блока в SpanPool<T>. Копирование — O(1)
+template <typename T>
+class PooledArray {
+public:
+    PooledArray() = default;
+    PooledArray(size_t n, const T& value) { assign(n, value); }
+    PooledArray(const PooledArray& other) { copyFrom(other); }
+    PooledArray& operator=(const PooledArray& other) {
+        if (this != &other) {
+            reset();
+            copyFrom(other);
+        }
+        return *this;
+    }
+    PooledArray& operator=(std::initializer_list<T> values) {
+        assign(values.begin(), values.end());
+        return *this;
+    }
+    ~PooledArray() { reset(); }
+
+    template <typename It>
+    void assign(It first, It last) {
+        resize(std::distance(first, last));
+        if (block != Pool::NoBlock) std::copy(first, last, pool().mutableData(block));
+    }
+    void assign(size_t n, const T& value) {
+        resize(n);
+        if (block != Pool::NoBlock) std::fill_n(pool().mutableData(block), n, value);
+    }
+
+    size_t size() const { return block == Pool::NoBlock ? 0 : pool().size(block); }
+    bool empty() const { return size() == 0; }
+    const T* data() const { return block == Pool::NoBlock ? nullptr : pool().data(block); }
+    const T* begin() const { return data(); }
+    const T* end() const { return data() + size(); }
+    const T& operator[](size_t i) const { return data()[i]; }
+    T& operator[](size_t i) { return pool().mutableData(block)[i]; }
+    const T& back() const { return data()[size() - 1]; }
+    // Ссылается на n элементов по адресу values вместо копии; копия появится при первой записи
+    void borrow(const T* values, size_t n, const std::shared_ptr<const void>& owner) {
+        reset();
+        if (n > 0) block = pool().borrow(values, n, owner);
+    }
+    // Тот же блок пула: копии, между которыми не было записи, совпадают без сравнения данных
+    bool sharesWith(const PooledArray& other) const { return block == other.block; }
+
+    void set(size_t i, const T& value) { pool().mutableData(block)[i] = value; }
+    void push_back(T value) { insert(size(), value); }
+    void insert(size_t index, T value) {
+        if (block == Pool::NoBlock) block = pool().allocate(0);
+        pool().insert(block, index, value);
+    }
+    void erase(size_t index) { pool().erase(block, index); }
+    void resize(size_t n) {
+        if (block == Pool::NoBlock) {
+            if (n == 0) return;
+            block = pool().allocate(n);
+            return;
+        }
+        pool().resize(block, n);
+    }
+    void clear() { resize(0); }
+
+private:
+    using Pool = SpanPool<T>;
+    static Pool& pool() { return Pool::instance(); }
+
+    void copyFrom(const PooledArray& other) {
+        if (other.block == Pool::NoBlock) return;
+        pool().retain(other.block);
+        block = other.block;
+    }
+
+    void reset() {
+        if (block != Pool::NoBlock) pool().release(block);
+        block = Pool::NoBlock;
+    }
+
+    uint32_t block = Pool::NoBlock;
+};
@@ -4,6 +4,6 @@
 class Hexagon : public PolylineFigure {
 public:
     Hexagon(float radius, const sf::Color& color, const std::vector<float>& thicknesses);
-        std::string getTypeName() const { return "Hexagon"; }
+        std::string_view getTypeName() const { return "Hexagon"; }
 
 };
\ No newline at end of file
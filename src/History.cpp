@@ -0,0 +1,288 @@
+#include "History.hpp"
+#include "Editor.hpp"
+#include "CompositeFigure.hpp"
+#include "PolylineFigure.hpp"
+#include "Circle.hpp"
+#include <algorithm>
+#include <cassert>
+
+static TransformState captureTransform(const AbstractFigure* fig) {
+    return {fig->getPosition(), fig->getScaleXY(), fig->getLocalPivot(), fig->getRotation()};
+}
+
+static void applyTransform(AbstractFigure* fig, const TransformState& s) {
+    fig->setPosition(s.position);
+    fig->setScale(s.scale);
+    fig->setRotation(s.rotation);
+    fig->setLocalPivot(s.pivot);
+}
+
+static bool sameTransform(const TransformState& a, const TransformState& b) {
+    return a.position == b.position && a.scale == b.scale && a.pivot == b.pivot && a.rotation == b.rotation;
+}
+
+static StyleState captureStyle(const AbstractFigure* fig) {
+    StyleState s;
+    s.fill = fig->getFillColor();
+    s.filled = fig->isFilled();
+    s.customName = FigureStore::instance().customName(fig->getEntity());
+    if (auto* circle = figureCast<Circle>(fig)) {
+        s.outline = circle->getOutlineColor();
+        s.outlineThickness = circle->getOutlineThickness();
+    }
+    return s;
+}
+
+static void applyStyle(AbstractFigure* fig, const StyleState& s) {
+    fig->setFillColor(s.fill);
+    fig->setFilled(s.filled);
+    FigureStore::instance().setCustomName(fig->getEntity(), s.customName);
+    if (auto* circle = figureCast<Circle>(fig)) {
+        circle->setOutlineColor(s.outline);
+        circle->setOutlineThickness(s.outlineThickness);
+    }
+}
+
+static bool sameStyle(const StyleState& a, const StyleState& b) {
+    return a.fill == b.fill && a.filled == b.filled && a.customName == b.customName &&
+           a.outline == b.outline && a.outlineThickness == b.outlineThickness;
+}
+
+static GeometryState captureGeometry(const AbstractFigure* fig) {
+    GeometryState s;
+    s.vertices = fig->getVertices();
+    if (auto* poly = figureCast<PolylineFigure>(fig)) {
+        s.thicknesses = poly->getThicknesses();
+        s.sideColors = poly->getSideColors();
+    }
+    return s;
+}
+
+static void applyGeometry(AbstractFigure* fig, const GeometryState& s) {
+    fig->setVertices(s.vertices);
+    if (auto* poly = figureCast<PolylineFigure>(fig))
+        poly->setSides(s.thicknesses, s.sideColors);
+}
+
+static bool sameGeometry(const GeometryState& a, const GeometryState& b) {
+    return a.vertices.sharesWith(b.vertices) && a.thicknesses.sharesWith(b.thicknesses) &&
+           a.sideColors.sharesWith(b.sideColors);
+}
+
+static size_t geometryBytes(const GeometryState& s) {
+    return s.vertices.size() * sizeof(sf::Vector2f) + s.thicknesses.size() * sizeof(float) +
+           s.sideColors.size() * sizeof(sf::Color);
+}
+
+size_t SceneChange::figureBytes(const AbstractFigure* fig) {
+    size_t total = sizeof(PolylineFigure) + fig->getVertexCount() * (sizeof(sf::Vector2f) + sizeof(float) + sizeof(sf::Color));
+    if (auto* comp = figureCast<CompositeFigure>(fig)) {
+        for (size_t i = 0; i < comp->getChildCount(); ++i)
+            total += figureBytes(comp->getChild(i));
+    }
+    return total;
+}
+
+void SceneChange::capture(AbstractFigure* fig) {
+    if (!fig || !seen.insert(fig).second) return;
+    snapshots.push_back({fig, captureTransform(fig), captureStyle(fig), captureGeometry(fig)});
+}
+
+// Новая фигура попадает в сцену впервые: её свойства не записываются,
+// при откате она лежит в limbo нетронутой
+void SceneChange::attachTop(AbstractFigure* fig, uint64_t z) {
+    seen.insert(fig);
+    steps.push_back({Step::AttachTop, 0, fig, nullptr, z, {}});
+}
+
+void SceneChange::detachTop(AbstractFigure* fig, uint64_t z, std::unique_ptr<AbstractFigure> owned) {
+    capture(fig);
+    steps.push_back({Step::DetachTop, 0, fig, nullptr, z, {}});
+    if (owned) keep(std::move(owned));
+}
+
+void SceneChange::dropScene(size_t count) {
+    steps.reserve(steps.size() + count);
+    limbo.reserve(limbo.size() + count);
+}
+
+void SceneChange::dropTop(AbstractFigure* fig, uint64_t z, std::unique_ptr<AbstractFigure> owned) {
+    steps.push_back({Step::DetachTop, 0, fig, nullptr, z, {}});
+    keep(std::move(owned));
+}
+
+void SceneChange::attachChild(AbstractFigure* fig, CompositeFigure* group, size_t index, sf::Vector2f offset) {
+    seen.insert(fig);
+    steps.push_back({Step::AttachChild, (uint32_t)index, fig, group, 0, offset});
+}
+
+void SceneChange::detachChild(AbstractFigure* fig, CompositeFigure* group, size_t index, sf::Vector2f offset,
+                              std::unique_ptr<AbstractFigure> owned) {
+    capture(fig);
+    steps.push_back({Step::DetachChild, (uint32_t)index, fig, group, 0, offset});
+    if (owned) keep(std::move(owned));
+}
+
+void SceneChange::moveZ(AbstractFigure* fig, uint64_t oldZ) {
+    steps.push_back({Step::MoveZ, 0, fig, nullptr, oldZ, {}});
+}
+
+void SceneChange::keep(std::unique_ptr<AbstractFigure> fig) {
+    const AbstractFigure* key = fig.get();
+    limboBytes += figureBytes(key);
+    limbo.emplace(key, std::move(fig));
+}
+
+// Фигуры нет в limbo только при рассогласовании шагов и сцены: в отладке это
+// остановит assert, в сборке без него шаг просто пропускается
+std::unique_ptr<AbstractFigure> SceneChange::release(AbstractFigure* fig) {
+    auto it = limbo.find(fig);
+    assert(it != limbo.end() && "figure is not owned by this change");
+    if (it == limbo.end()) return nullptr;
+    std::unique_ptr<AbstractFigure> result = std::move(it->second);
+    limbo.erase(it);
+    limboBytes -= figureBytes(fig);
+    return result;
+}
+
+size_t SceneChange::recordedBytes() const {
+    return steps.size() * sizeof(Step) + snapshots.size() * sizeof(Snapshot) + limboBytes;
+}
+
+bool SceneChange::finish() {
+    for (Snapshot& snap : snapshots) {
+        AbstractFigure* fig = snap.figure;
+        if (!sameTransform(snap.transform, captureTransform(fig)))
+            transforms.push_back({fig, snap.transform});
+        if (!sameStyle(snap.style, captureStyle(fig)))
+            styles.push_back({fig, snap.style});
+        GeometryState now = captureGeometry(fig);
+        if (!sameGeometry(snap.geometry, now)) {
+            bytes += geometryBytes(snap.geometry) + geometryBytes(now);
+            geometries.push_back({fig, std::move(snap.geometry)});
+        }
+    }
+    snapshots.clear();
+    snapshots.shrink_to_fit();
+    seen.clear();
+    for (const Step& step : steps) {
+        // Вставленные фигуры при откате тоже окажутся здесь
+        if (step.kind == Step::AttachTop || step.kind == Step::AttachChild) bytes += figureBytes(step.figure);
+    }
+    bytes += limboBytes;
+    bytes += sizeof(*this) + steps.size() * sizeof(Step) +
+             transforms.size() * sizeof(transforms[0]) + styles.size() * sizeof(styles[0]) +
+             geometries.size() * sizeof(geometries[0]);
+    steps.shrink_to_fit();
+    return !steps.empty() || !transforms.empty() || !styles.empty() || !geometries.empty();
+}
+
+// Вставка вперёд — то же, что удаление назад, и наоборот
+void SceneChange::apply(Editor& editor, Step& step, bool forward) {
+    bool attach = (step.kind == Step::AttachTop || step.kind == Step::AttachChild) == forward;
+    switch (step.kind) {
+        case Step::AttachTop:
+        case Step::DetachTop:
+            if (!attach) keep(editor.detachTop(step.figure));
+            else if (auto fig = release(step.figure)) editor.attachAt(std::move(fig), step.z);
+            break;
+        case Step::AttachChild:
+        case Step::DetachChild:
+            if (!attach) keep(editor.detachFromGroup(step.group, step.index));
+            else if (auto fig = release(step.figure)) editor.attachToGroup(step.group, step.index, std::move(fig), step.offset);
+            break;
+        case Step::MoveZ:
+            step.z = editor.setZ(step.figure, step.z);
+            break;
+    }
+}
+
+void SceneChange::swapStates() {
+    for (auto& r : transforms) {
+        TransformState now = captureTransform(r.figure);
+        applyTransform(r.figure, r.state);
+        r.state = now;
+    }
+    for (auto& r : styles) {
+        StyleState now = captureStyle(r.figure);
+        applyStyle(r.figure, r.state);
+        r.state = now;
+    }
+    for (auto& r : geometries) {
+        GeometryState now = captureGeometry(r.figure);
+        applyGeometry(r.figure, r.state);
+        r.state = std::move(now);
+    }
+}
+
+// Свойства принадлежат самим фигурам и не зависят от их места в сцене,
+// поэтому меняются после структурных шагов в обоих направлениях
+void SceneChange::undo(Editor& editor) {
+    for (size_t i = steps.size(); i-- > 0;) apply(editor, steps[i], false);
+    swapStates();
+}
+
+void SceneChange::redo(Editor& editor) {
+    for (Step& step : steps) apply(editor, step, true);
+    swapStates();
+}
+
+void SceneChange::remapZ(const std::function<uint64_t(uint64_t)>& remap) {
+    for (Step& step : steps) {
+        if (step.kind == Step::AttachTop || step.kind == Step::DetachTop || step.kind == Step::MoveZ)
+            step.z = remap(step.z);
+    }
+}
+
+void History::push(std::unique_ptr<Command> command) {
+    for (const auto& c : undone) used -= c->memoryUsage();
+    undone.clear();
+    used += command->memoryUsage();
+    done.push_back(std::move(command));
+    trim();
+}
+
+bool History::undo(Editor& editor) {
+    if (done.empty()) return false;
+    done.back()->undo(editor);
+    undone.push_back(std::move(done.back()));
+    done.pop_back();
+    return true;
+}
+
+bool History::redo(Editor& editor) {
+    if (undone.empty()) return false;
+    undone.back()->redo(editor);
+    done.push_back(std::move(undone.back()));
+    undone.pop_back();
+    return true;
+}
+
+void History::clear() {
+    undone.clear();
+    done.clear();
+    used = 0;
+}
+
+void History::setBudget(size_t bytes) {
+    budget = bytes;
+    trim();
+}
+
+// Старые команды ссылаются только на фигуры, которые живут в сцене или в limbo
+// более новых команд, поэтому их можно выбрасывать с начала без нарушения остальных
+void History::trim() {
+    while (used > budget && !done.empty()) {
+        used -= done.front()->memoryUsage();
+        done.pop_front();
+    }
+    if (used > budget) {
+        for (const auto& c : undone) used -= c->memoryUsage();
+        undone.clear();
+    }
+}
+
+void History::remapZ(const std::function<uint64_t(uint64_t)>& remap) {
+    for (auto& c : done) c->remapZ(remap);
+    for (auto& c : undone) c->remapZ(remap);
+}
@@ -0,0 +1,148 @@
+#pragma once
+#include "AbstractFigure.hpp"
+#include <deque>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <unordered_set>
+#include <unordered_map>
+#include <cstdint>
+
+class Editor;
+class CompositeFigure;
+
+// Команда истории: уже выполненная правка, которую можно откатить и повторить
+class Command {
+public:
+    virtual ~Command() = default;
+    virtual void undo(Editor& editor) = 0;
+    virtual void redo(Editor& editor) = 0;
+    // Оценка занятой памяти в байтах, по ней история держит бюджет
+    virtual size_t memoryUsage() const = 0;
+    // Ключи порядка отрисовки перенумерованы; remap переводит старый ключ в новый
+    virtual void remapZ(const std::function<uint64_t(uint64_t)>& /*remap*/) {}
+};
+
+// Свойства фигуры по группам: запись хранит одно состояние, а откат и повтор
+// меняют его местами с текущим — половина памяти пары «до/после»
+struct TransformState {
+    sf::Vector2f position, scale, pivot;
+    float rotation = 0.f;
+};
+
+struct StyleState {
+    sf::Color fill, outline;
+    float outlineThickness = 0.f;
+    bool filled = false;
+    Symbol customName = 0;
+};
+
+// Массивы разделяют блоки пула с фигурой, пока одна из сторон их не изменит
+struct GeometryState {
+    PooledArray<sf::Vector2f> vertices;
+    PooledArray<float> thicknesses;
+    PooledArray<sf::Color> sideColors;
+};
+
+// Одна правка пользователя. Структурные шаги (вставка и удаление фигур, перенос
+// в группу и из неё, смена слоя) хранятся по порядку и откатываются в обратном.
+// Свойства записываются только у фигур, которые действительно изменились.
+// Фигуры, которые сейчас вне сцены из-за этой правки, принадлежат ей (limbo)
+class SceneChange : public Command {
+public:
+    // Запоминает свойства fig до правки; повторный вызов ничего не делает
+    void capture(AbstractFigure* fig);
+    void attachTop(AbstractFigure* fig, uint64_t z);
+    // owned — фигура удалена и переходит к правке; nullptr — её забрал вызывающий
+    void detachTop(AbstractFigure* fig, uint64_t z, std::unique_ptr<AbstractFigure> owned);
+    // Прежняя сцена при загрузке: в эту правку фигуры больше не вернутся,
+    // поэтому их свойства не запоминаются. count — сколько фигур уйдёт
+    void dropScene(size_t count);
+    void dropTop(AbstractFigure* fig, uint64_t z, std::unique_ptr<AbstractFigure> owned);
+    void attachChild(AbstractFigure* fig, CompositeFigure* group, size_t index, sf::Vector2f offset);
+    void detachChild(AbstractFigure* fig, CompositeFigure* group, size_t index, sf::Vector2f offset,
+                     std::unique_ptr<AbstractFigure> owned);
+    void moveZ(AbstractFigure* fig, uint64_t oldZ);
+    // Сравнивает запомненные свойства с текущими; false — правка пустая
+    bool finish();
+    // Сколько байт записано на этот момент (для отказа от записи сверх бюджета)
+    size_t recordedBytes() const;
+    // Грубая оценка памяти фигуры вместе с поддеревом
+    static size_t figureBytes(const AbstractFigure* fig);
+
+    void undo(Editor& editor) override;
+    void redo(Editor& editor) override;
+    size_t memoryUsage() const override { return bytes; }
+    void remapZ(const std::function<uint64_t(uint64_t)>& remap) override;
+
+private:
+    struct Step {
+        enum Kind : uint8_t { AttachTop, DetachTop, AttachChild, DetachChild, MoveZ };
+        Kind kind;
+        uint32_t index = 0;         // место в группе
+        AbstractFigure* figure;
+        CompositeFigure* group = nullptr;
+        uint64_t z = 0;             // ключ слоя; для MoveZ — другой ключ пары
+        sf::Vector2f offset;
+    };
+    struct Snapshot {
+        AbstractFigure* figure;
+        TransformState transform;
+        StyleState style;
+        GeometryState geometry;
+    };
+    template <typename State>
+    struct Record {
+        AbstractFigure* figure;
+        State state;
+    };
+
+    void apply(Editor& editor, Step& step, bool forward);
+    void swapStates();
+    void keep(std::unique_ptr<AbstractFigure> fig);
+    std::unique_ptr<AbstractFigure> release(AbstractFigure* fig);
+
+    std::vector<Step> steps;
+    std::vector<Record<TransformState>> transforms;
+    std::vector<Record<StyleState>> styles;
+    std::vector<Record<GeometryState>> geometries;
+    // По адресу: откат загрузки сцены возвращает из limbo все прежние фигуры
+    std::unordered_map<const AbstractFigure*, std::unique_ptr<AbstractFigure>> limbo;
+    size_t limboBytes = 0;
+    size_t bytes = 0;
+
+    // Только на время записи
+    std::vector<Snapshot> snapshots;
+    std::unordered_set<const AbstractFigure*> seen;
+};
+
+// Линейная история с бюджетом памяти: при превышении выбрасываются самые старые команды
+class History {
+public:
+    static constexpr size_t DefaultBudget = size_t(64) << 20;
+
+    explicit History(size_t budgetBytes = DefaultBudget) : budget(budgetBytes) {}
+
+    // Команда уже выполнена; ветка повтора отбрасывается
+    void push(std::unique_ptr<Command> command);
+    bool undo(Editor& editor);
+    bool redo(Editor& editor);
+    bool canUndo() const { return !done.empty(); }
+    bool canRedo() const { return !undone.empty(); }
+    void clear();
+
+    void setBudget(size_t bytes);
+    size_t getBudget() const { return budget; }
+    size_t getMemoryUsage() const { return used; }
+    size_t size() const { return done.size() + undone.size(); }
+
+    void remapZ(const std::function<uint64_t(uint64_t)>& remap);
+
+private:
+    void trim();
+
+    std::deque<std::unique_ptr<Command>> done;
+    std::vector<std::unique_ptr<Command>> undone;
+    size_t budget;
+    size_t used = 0;
+};
@@ -0,0 +1,38 @@
+#include "MappedFile.hpp"
+#include <fstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+std::shared_ptr<const MappedFile> MappedFile::open(const std::string& filename) {
+    std::shared_ptr<MappedFile> file(new MappedFile());
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        struct stat info;
+        if (fstat(fd, &info) == 0 && info.st_size > 0) {
+            void* p = mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                file->bytes = static_cast<const char*>(p);
+                file->length = size_t(info.st_size);
+                file->mapped = true;
+            }
+        }
+        ::close(fd);
+        if (file->mapped) return file;
+    }
+
+    std::ifstream in(filename, std::ios::binary);
+    if (!in) return nullptr;
+    in.seekg(0, std::ios::end);
+    file->copy.resize(size_t(in.tellg()));
+    in.seekg(0);
+    in.read(file->copy.data(), file->copy.size());
+    file->bytes = file->copy.data();
+    file->length = file->copy.size();
+    return file;
+}
+
+MappedFile::~MappedFile() {
+    if (mapped) munmap(const_cast<char*>(bytes), length);
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <cstddef>
+
+// Файл, отображённый в память только для чтения. Страницы подгружаются при первом
+// обращении и делятся через кэш ОС между всеми процессами, открывшими тот же файл.
+// Если отобразить не удалось, содержимое читается в обычный буфер
+class MappedFile {
+public:
+    // nullptr — файл не открылся
+    static std::shared_ptr<const MappedFile> open(const std::string& filename);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const { return bytes; }
+    size_t size() const { return length; }
+    // Данные в отображении, а не в копии: на них можно ссылаться вместо копирования
+    bool isMapped() const { return mapped; }
+
+private:
+    MappedFile() = default;
+
+    const char* bytes = nullptr;
+    size_t length = 0;
+    bool mapped = false;
+    std::string copy;
+};
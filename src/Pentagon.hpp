@@ -4,6 +4,6 @@
 class Pentagon : public PolylineFigure {
 public:
     Pentagon(float radius, const sf::Color& color, const std::vector<float>& thicknesses);
-        std::string getTypeName() const { return "Pentagon"; }
+        std::string_view getTypeName() const { return "Pentagon"; }
 
 };
\ No newline at end of file
@@ -0,0 +1,131 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Неизменяемое отображение uint32_t -> V: префиксное дерево по 5 бит ключа на уровень
+// (hash array mapped trie, ключ служит хешем сам). Узел хранит битовую маску занятых
+// ячеек и только занятые ячейки подряд.
+// Копия — O(1): копии делят узлы. Правка меняет на месте только узлы, которыми
+// никто больше не владеет, а общие копирует по пути от корня (O(log32 n) узлов).
+// Узлы, доступные из чужой копии, не меняются никогда, поэтому копию можно читать
+// из другого потока, пока исходное отображение правится.
+template <typename V>
+class PersistentMap {
+public:
+    const V* find(uint32_t key) const {
+        const Node* node = root.get();
+        for (unsigned shift = 0; node; shift += Bits) {
+            uint32_t bit = bitOf(key, shift);
+            if (!(node->bitmap & bit)) return nullptr;
+            const Slot& slot = node->slots[indexOf(node, bit)];
+            if (!slot.child) return slot.key == key ? &slot.value : nullptr;
+            node = slot.child.get();
+        }
+        return nullptr;
+    }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    void set(uint32_t key, V value) {
+        std::shared_ptr<Node>* ref = &root;
+        if (!root) root = std::make_shared<Node>();
+        for (unsigned shift = 0;; shift += Bits) {
+            Node* node = own(*ref);
+            uint32_t bit = bitOf(key, shift);
+            size_t pos = indexOf(node, bit);
+            if (!(node->bitmap & bit)) {
+                node->bitmap |= bit;
+                node->slots.insert(node->slots.begin() + pos, Slot{key, nullptr, std::move(value)});
+                ++count;
+                return;
+            }
+            Slot& slot = node->slots[pos];
+            if (!slot.child) {
+                if (slot.key == key) {
+                    slot.value = std::move(value);
+                    return;
+                }
+                // Два ключа в одной ячейке: прежний уходит уровнем ниже. Разные ключи
+                // расходятся не позже последнего уровня, так что спуск конечен
+                auto child = std::make_shared<Node>();
+                child->bitmap = bitOf(slot.key, shift + Bits);
+                child->slots.push_back(Slot{slot.key, nullptr, std::move(slot.value)});
+                slot.value = V();
+                slot.child = std::move(child);
+            }
+            ref = &slot.child;
+        }
+    }
+
+    void erase(uint32_t key) {
+        if (!find(key)) return;
+        eraseIn(root, key, 0);
+        --count;
+        if (root->slots.empty()) root.reset();
+    }
+
+    void clear() {
+        root.reset();
+        count = 0;
+    }
+
+    // fn(key, value) для каждой записи; порядок — по битам ключа, не по возрастанию
+    template <typename Fn>
+    void forEach(Fn&& fn) const {
+        if (root) visit(root.get(), fn);
+    }
+
+private:
+    static constexpr unsigned Bits = 5;
+
+    struct Node;
+    struct Slot {
+        uint32_t key;
+        std::shared_ptr<Node> child;   // непустой — ячейка ведёт в поддерево
+        V value;
+    };
+    struct Node {
+        uint32_t bitmap = 0;
+        std::vector<Slot> slots;
+    };
+
+    static uint32_t bitOf(uint32_t key, unsigned shift) {
+        return shift < 32 ? uint32_t(1) << ((key >> shift) & 31) : 1;
+    }
+    static size_t indexOf(const Node* node, uint32_t bit) {
+        return __builtin_popcount(node->bitmap & (bit - 1));
+    }
+
+    // Узел, который можно менять: общий сначала копируется
+    static Node* own(std::shared_ptr<Node>& ref) {
+        if (ref.use_count() > 1) ref = std::make_shared<Node>(*ref);
+        return ref.get();
+    }
+
+    static void eraseIn(std::shared_ptr<Node>& ref, uint32_t key, unsigned shift) {
+        Node* node = own(ref);
+        uint32_t bit = bitOf(key, shift);
+        size_t pos = indexOf(node, bit);
+        Slot& slot = node->slots[pos];
+        if (slot.child) {
+            eraseIn(slot.child, key, shift + Bits);
+            if (!slot.child->slots.empty()) return;
+        }
+        node->bitmap &= ~bit;
+        node->slots.erase(node->slots.begin() + pos);
+    }
+
+    template <typename Fn>
+    static void visit(const Node* node, Fn& fn) {
+        for (const Slot& slot : node->slots) {
+            if (slot.child) visit(slot.child.get(), fn);
+            else fn(slot.key, slot.value);
+        }
+    }
+
+    std::shared_ptr<Node> root;
+    size_t count = 0;
+};
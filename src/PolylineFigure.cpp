@@ -1,42 +1,82 @@
 #include "PolylineFigure.hpp"
+#include "SceneBinary.hpp"
 #include <cmath>
 #include <algorithm>
 
 PolylineFigure::PolylineFigure(const sf::Color& outlineColor, const std::vector<float>& thicknesses)
-    : thicknesses(thicknesses) {
+    : AbstractFigure(Kind) {
+    this->thicknesses.assign(thicknesses.begin(), thicknesses.end());
     sideColors.assign(thicknesses.size(), outlineColor);
 }
 
 std::unique_ptr<AbstractFigure> PolylineFigure::clone() const {
     auto newFig = std::make_unique<PolylineFigure>(
         sideColors.empty() ? sf::Color::White : sideColors[0],
-        thicknesses
+        std::vector<float>()
     );
+    // Массивы разделяются с оригиналом до первой правки любой из копий
+    newFig->thicknesses = thicknesses;
     newFig->vertices = vertices;
     newFig->sideColors = sideColors;
-    newFig->position = position;
-    newFig->scaleFactor = scaleFactor;
-    newFig->fillColor = fillColor;
-    newFig->filled = filled;
+    newFig->setPosition(getPosition());
+    newFig->setScale(getScaleXY());
+    newFig->setRotation(getRotation());
+    newFig->setFillColor(getFillColor());
+    newFig->setFilled(isFilled());
     newFig->pivot = pivot;
+    // Геометрия та же, значит и кэш рамки верен
+    newFig->localBounds = localBounds;
+    newFig->maxThickness = maxThickness;
+    newFig->localBoundsDirty = localBoundsDirty;
     return newFig;
 }
 
-void PolylineFigure::draw(sf::RenderWindow& window) const {
+// Рамка по вершинам с запасом в половину самой толстой стороны
+static sf::FloatRect pointsBounds(const sf::Vector2f* points, size_t n, float margin) {
+    float minX = points[0].x, maxX = points[0].x;
+    float minY = points[0].y, maxY = points[0].y;
+    for (size_t i = 1; i < n; ++i) {
+        minX = std::min(minX, points[i].x);
+        maxX = std::max(maxX, points[i].x);
+        minY = std::min(minY, points[i].y);
+        maxY = std::max(maxY, points[i].y);
+    }
+    return sf::FloatRect(minX - margin, minY - margin, maxX - minX + 2 * margin, maxY - minY + 2 * margin);
+}
+
+// Заливка и стороны одним массивом треугольников: один вызов отрисовки на фигуру
+void PolylineFigure::draw(sf::RenderTarget& target, const sf::Transform& parent) const {
     if (vertices.size() < 2) return;
+    sf::VertexArray triangles(sf::Triangles);
+    std::vector<sf::Vector2f> scratch;
+    appendTriangles(getWorldVertices(scratch), 1.f, triangles);
+    target.draw(triangles, parent);
+}
+
+void PolylineFigure::tessellate(const sf::Transform& t, float worldScale, sf::VertexArray& out) const {
+    if (vertices.size() < 2 || worldScale <= 0) return;
+    std::vector<sf::Vector2f> points(vertices.size());
+    for (size_t i = 0; i < vertices.size(); ++i)
+        points[i] = t.transformPoint(vertices[i]);
+    appendTriangles(points, worldScale, out);
+}
 
-    std::vector<sf::Vector2f> global;
-    for (const auto& v : vertices)
-        global.push_back(position + v * scaleFactor);
+// Заливка — веером от центра рамки вершин через все стороны, как строит его
+// sf::Shape::update для sf::ConvexShape; стороны — четырёхугольники по точкам
+// стыка соседних полос. Толщины делятся на worldScale
+void PolylineFigure::appendTriangles(const std::vector<sf::Vector2f>& global, float worldScale,
+                                     sf::VertexArray& out) const {
     size_t n = global.size();
 
-    if (filled && n >= 3) {
-        sf::ConvexShape fillShape;
-        fillShape.setPointCount(n);
-        for (size_t i = 0; i < n; ++i)
-            fillShape.setPoint(i, global[i]);
-        fillShape.setFillColor(fillColor);
-        window.draw(fillShape);
+    if (isFilled() && n >= 3) {
+        sf::Color fill = getFillColor();
+        sf::FloatRect box = pointsBounds(global.data(), n, 0.f);
+        sf::Vector2f center(box.left + box.width / 2, box.top + box.height / 2);
+        for (size_t i = 0; i < n; ++i) {
+            out.append({center, fill});
+            out.append({global[i], fill});
+            out.append({global[(i + 1) % n], fill});
+        }
     }
 
     std::vector<sf::Vector2f> outPoint(n), inPoint(n);
@@ -48,8 +88,8 @@ void PolylineFigure::draw(sf::RenderWindow& window) const {
         sf::Vector2f P = global[prev];
         sf::Vector2f N = global[next];
 
-        float t_prev = thicknesses[prev];
-        float t_next = thicknesses[i];
+        float t_prev = thicknesses[prev] / worldScale;
+        float t_next = thicknesses[i] / worldScale;
 
         sf::Vector2f dir_prev = V - P;
         sf::Vector2f dir_next = N - V;
@@ -90,14 +130,13 @@ void PolylineFigure::draw(sf::RenderWindow& window) const {
 
     for (size_t i = 0; i < n; ++i) {
         size_t j = (i + 1) % n;
-        sf::ConvexShape quad;
-        quad.setPointCount(4);
-        quad.setPoint(0, outPoint[i]);
-        quad.setPoint(1, outPoint[j]);
-        quad.setPoint(2, inPoint[j]);
-        quad.setPoint(3, inPoint[i]);
-        quad.setFillColor(sideColors[i]);
-        window.draw(quad);
+        sf::Color color = sideColors[i];
+        out.append({outPoint[i], color});
+        out.append({outPoint[j], color});
+        out.append({inPoint[j], color});
+        out.append({outPoint[i], color});
+        out.append({inPoint[j], color});
+        out.append({inPoint[i], color});
     }
 }
 
@@ -105,32 +144,143 @@ bool PolylineFigure::contains(const sf::Vector2f& point) const {
     return getBoundingBox().contains(point);
 }
 
+// Рамка вершин в локальных координатах и самая толстая сторона
+static void measure(const PooledArray<sf::Vector2f>& vertices, const PooledArray<float>& thicknesses,
+                    sf::FloatRect& box, float& thickest) {
+    box = sf::FloatRect();
+    if (!vertices.empty()) {
+        float minX = vertices[0].x, maxX = vertices[0].x;
+        float minY = vertices[0].y, maxY = vertices[0].y;
+        for (const auto& v : vertices) {
+            minX = std::min(minX, v.x);
+            maxX = std::max(maxX, v.x);
+            minY = std::min(minY, v.y);
+            maxY = std::max(maxY, v.y);
+        }
+        box = sf::FloatRect(minX, minY, maxX - minX, maxY - minY);
+    }
+    thickest = thicknesses.empty() ? 0 : *std::max_element(thicknesses.begin(), thicknesses.end());
+}
+
+void PolylineFigure::localExtent(sf::FloatRect& box, float& thickest) const {
+    if (localBoundsDirty) {
+        measure(vertices, thicknesses, box, thickest);
+        return;
+    }
+    box = localBounds;
+    thickest = maxThickness;
+}
+
+void PolylineFigure::refreshLocalBounds() {
+    if (!localBoundsDirty) return;
+    measure(vertices, thicknesses, localBounds, maxThickness);
+    localBoundsDirty = false;
+}
+
+bool PolylineFigure::worldVerticesCached() const {
+    return !worldDirty && worldCached() && worldStamp == FigureStore::instance().worldStamp(entity);
+}
+
+const std::vector<sf::Vector2f>& PolylineFigure::getWorldVertices(std::vector<sf::Vector2f>& scratch) const {
+    if (worldVerticesCached()) return worldVertices;
+    sf::Transform world = getWorldTransform();
+    scratch.resize(vertices.size());
+    for (size_t i = 0; i < vertices.size(); ++i)
+        scratch[i] = world.transformPoint(vertices[i]);
+    return scratch;
+}
+
+void PolylineFigure::refreshWorld() {
+    AbstractFigure::refreshWorld();
+    refreshLocalBounds();
+    if (sideIndexDirty && vertices.size() >= IndexedSides) {
+        sideIndex.build(vertices.data(), vertices.size());
+        sideIndexDirty = false;
+    }
+    if (worldVerticesCached()) return;
+    const sf::Transform& world = FigureStore::instance().world(entity);
+    worldVertices.resize(vertices.size());
+    for (size_t i = 0; i < vertices.size(); ++i)
+        worldVertices[i] = world.transformPoint(vertices[i]);
+    worldBounds = vertices.empty() ? sf::FloatRect()
+                                   : pointsBounds(worldVertices.data(), worldVertices.size(), maxThickness / 2);
+    worldStamp = FigureStore::instance().worldStamp(entity);
+    worldDirty = false;
+}
+
 sf::FloatRect PolylineFigure::getBoundingBox() const {
     if (vertices.empty()) return {0,0,0,0};
-    std::vector<sf::Vector2f> global;
-    for (const auto& v : vertices)
-        global.push_back(position + v * scaleFactor);
-    float minX = global[0].x, maxX = global[0].x;
-    float minY = global[0].y, maxY = global[0].y;
-    for (auto& v : global) {
-        minX = std::min(minX, v.x);
-        maxX = std::max(maxX, v.x);
-        minY = std::min(minY, v.y);
-        maxY = std::max(maxY, v.y);
-    }
-    float maxThick = thicknesses.empty() ? 0 : *std::max_element(thicknesses.begin(), thicknesses.end());
-    return sf::FloatRect(minX - maxThick/2, minY - maxThick/2,
-                         (maxX - minX) + maxThick, (maxY - minY) + maxThick);
+    sf::Transform world = getWorldTransform();
+    sf::FloatRect box;
+    float thickest;
+    localExtent(box, thickest);
+    const float* m = world.getMatrix();
+    if (m[1] == 0.f && m[4] == 0.f) {
+        // Без поворота рамка вершин переходит в мировую рамку целиком: если рамка
+        // известна, сами вершины не читаются, и геометрия из файла остаётся незатронутой
+        sf::FloatRect r = world.transformRect(box);
+        float margin = thickest / 2;
+        return sf::FloatRect(r.left - margin, r.top - margin, r.width + 2 * margin, r.height + 2 * margin);
+    }
+    if (worldVerticesCached()) return worldBounds;
+    return transformedBounds(world, thickest / 2);
+}
+
+sf::FloatRect PolylineFigure::getBoundsUnder(const sf::Transform& t) const {
+    if (vertices.empty()) return {0,0,0,0};
+    sf::FloatRect box;
+    float thickest;
+    localExtent(box, thickest);
+    return transformedBounds(t, thickest / 2);
+}
+
+// То же, что pointsBounds по вершинам, переведённым t, но без промежуточного массива
+sf::FloatRect PolylineFigure::transformedBounds(const sf::Transform& t, float margin) const {
+    sf::Vector2f first = t.transformPoint(vertices[0]);
+    float minX = first.x, maxX = first.x;
+    float minY = first.y, maxY = first.y;
+    for (size_t i = 1; i < vertices.size(); ++i) {
+        sf::Vector2f p = t.transformPoint(vertices[i]);
+        minX = std::min(minX, p.x);
+        maxX = std::max(maxX, p.x);
+        minY = std::min(minY, p.y);
+        maxY = std::max(maxY, p.y);
+    }
+    return sf::FloatRect(minX - margin, minY - margin, maxX - minX + 2 * margin, maxY - minY + 2 * margin);
 }
 
 void PolylineFigure::setThickness(size_t index, float thick) {
-    if (index < thicknesses.size())
-        thicknesses[index] = thick;
+    if (index < thicknesses.size()) {
+        thicknesses.set(index, thick);
+        localBoundsDirty = worldDirty = true;
+        invalidateBounds();
+    }
 }
 
 void PolylineFigure::setSideColor(size_t index, sf::Color color) {
-    if (index < sideColors.size())
-        sideColors[index] = color;
+    if (index < sideColors.size()) {
+        sideColors.set(index, color);
+        invalidateStyle();
+    }
+}
+
+void PolylineFigure::setAllThicknesses(float thick) {
+    thicknesses.assign(thicknesses.size(), thick);
+    localBoundsDirty = worldDirty = true;
+    invalidateBounds();
+}
+
+void PolylineFigure::setAllSideColors(sf::Color color) {
+    sideColors.assign(sideColors.size(), color);
+    invalidateStyle();
+}
+
+void PolylineFigure::setSides(const PooledArray<float>& thick, const PooledArray<sf::Color>& colors) {
+    thicknesses = thick;
+    sideColors = colors;
+    localBoundsDirty = worldDirty = true;
+    invalidateBounds();
+    invalidateStyle();
 }
 
 sf::Color PolylineFigure::getSideColor(size_t index) const {
@@ -145,15 +295,48 @@ void PolylineFigure::addVertex(const sf::Vector2f& pos) {
         thicknesses.push_back(thicknesses.back());
         sideColors.push_back(sideColors.back());
     }
+    onVerticesChanged();
+    invalidateBounds();
 }
 
 void PolylineFigure::removeVertex(size_t index) {
     if (index >= vertices.size()) return;
-    vertices.erase(vertices.begin() + index);
+    vertices.erase(index);
     if (index < thicknesses.size()) {
-        thicknesses.erase(thicknesses.begin() + index);
-        sideColors.erase(sideColors.begin() + index);
+        thicknesses.erase(index);
+        sideColors.erase(index);
+    }
+    onVerticesChanged();
+    invalidateBounds();
+}
+
+void PolylineFigure::insertVertex(size_t index, const sf::Vector2f& pos) {
+    index = std::min(index, vertices.size());
+    vertices.insert(index, pos);
+    if (!thicknesses.empty()) {
+        size_t src = std::min(index > 0 ? index - 1 : 0, thicknesses.size() - 1);
+        size_t at = std::min(index, thicknesses.size());
+        thicknesses.insert(at, getThicknesses()[src]);
+        sideColors.insert(at, getSideColors()[src]);
     }
+    onVerticesChanged();
+    invalidateBounds();
+}
+
+// Поиск идёт в локальных координатах; при неравномерном масштабе радиус берётся
+// по меньшей оси, и вызывающий сверяет найденное расстояние уже в сцене
+long PolylineFigure::findNearestSide(const sf::Vector2f& point, float maxDistance, sf::Vector2f& localPoint) const {
+    const sf::Transform& world = getWorldTransform();
+    float stretch = minStretch(world);
+    if (vertices.size() < 2 || stretch <= 0) return -1;
+    SegmentIndex scratch;
+    if (sideIndexDirty) scratch.build(vertices.data(), vertices.size());
+    const SegmentIndex& index = sideIndexDirty ? scratch : sideIndex;
+    // Сетка в локальных координатах: радиус поиска берётся по самому сжатому
+    // направлению, а кандидаты сравниваются по расстоянию в сцене
+    sf::Vector2f local = world.getInverse().transformPoint(point);
+    return index.nearest(vertices.data(), vertices.size(), world, point, local, maxDistance / stretch,
+                         maxDistance, localPoint);
 }
 /*
 void PolylineFigure::serialize(std::ostream& out) const {
@@ -197,51 +380,27 @@ void PolylineFigure::deserialize(std::istream& in) {
 */
 
 
-void PolylineFigure::serialize(std::ostream& out) const {
-    AbstractFigure::serialize(out);
-    size_t n = vertices.size();
-    out << n << '\n';
-    for (size_t i = 0; i < n; ++i) 
-        out << vertices[i].x << ' ' << vertices[i].y << ' ';
-    out << '\n';
-    
-    // Записываем n толщин и n цветов (для замкнутого контура)
-    for (size_t i = 0; i < n; ++i) {
-        float t = (i < thicknesses.size()) ? thicknesses[i] : 2.0f; // запасной вариант
-        out << t << ' ';
-    }
-    out << '\n';
-    for (size_t i = 0; i < n; ++i) {
-        sf::Color c = (i < sideColors.size()) ? sideColors[i] : sf::Color::White;
-        out << (int)c.r << ' ' << (int)c.g << ' ' << (int)c.b << ' ';
-    }
-    out << '\n';
-}
-
-void PolylineFigure::deserialize(std::istream& in) {
-    AbstractFigure::deserialize(in); // Сначала читаем общие данные
-
-    size_t n;
-    if (!(in >> n)) return;
-
-    vertices.resize(n);
-    thicknesses.resize(n);
-    sideColors.resize(n);
-
-    // Читаем координаты всех вершин
-    for (size_t i = 0; i < n; ++i) {
-        in >> vertices[i].x >> vertices[i].y;
+void PolylineFigure::readBinary(SceneReader& in) {
+    AbstractFigure::readBinary(in);
+    // На вершину приходятся координаты, толщина и цвет
+    size_t n = in.count(sizeof(sf::Vector2f) + sizeof(float) + sizeof(sf::Color));
+    sf::FloatRect bounds;
+    float thickest = 0.f;
+    if (in.formatVersion() >= 2) {
+        sf::Vector2f corner = in.vec(), size = in.vec();
+        bounds = sf::FloatRect(corner, size);
+        thickest = in.f32();
+        in.align(SceneBinary::ArrayAlignment);
     }
-
-    // Читаем толщины
-    for (size_t i = 0; i < n; ++i) {
-        in >> thicknesses[i];
-    }
-
-    // Читаем цвета сторон
-    for (size_t i = 0; i < n; ++i) {
-        int r, g, b;
-        in >> r >> g >> b;
-        sideColors[i] = sf::Color(r, g, b);
+    in.readArray(vertices, n, sizeof(float));
+    in.readArray(thicknesses, n, sizeof(float));
+    in.readArray(sideColors, n, 1);
+    onVerticesChanged();
+    // Рамка из файла: вершины не читаются, пока фигура не понадобится на экране
+    if (in.formatVersion() >= 2 && n > 0) {
+        localBounds = bounds;
+        maxThickness = thickest;
+        localBoundsDirty = false;
     }
+    invalidateBounds();
 }
\ No newline at end of file
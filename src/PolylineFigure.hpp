@@ -1,30 +1,71 @@
 #pragma once
 #include "AbstractFigure.hpp"
+#include "SegmentIndex.hpp"
 
 class PolylineFigure : public AbstractFigure {
 public:
+    static constexpr FigureKind Kind = FigureKind::Polyline;
+
     PolylineFigure(const sf::Color& outlineColor, const std::vector<float>& thicknesses);
-    void draw(sf::RenderWindow& window) const override;
+    using AbstractFigure::draw;
+    void draw(sf::RenderTarget& target, const sf::Transform& parent) const override;
     bool contains(const sf::Vector2f& point) const override;
     sf::FloatRect getBoundingBox() const override;
+    sf::FloatRect getBoundsUnder(const sf::Transform& t) const override;
+    void tessellate(const sf::Transform& t, float worldScale, sf::VertexArray& out) const override;
     std::unique_ptr<AbstractFigure> clone() const override;
 
     void setThickness(size_t index, float thick);
     void setSideColor(size_t index, sf::Color color);
+    // Все стороны сразу, с одной инвалидацией
+    void setAllThicknesses(float thick);
+    void setAllSideColors(sf::Color color);
     sf::Color getSideColor(size_t index) const;
-    const std::vector<float>& getThicknesses() const { return thicknesses; }
-    const std::vector<sf::Color>& getSideColors() const { return sideColors; }
+    const PooledArray<float>& getThicknesses() const { return thicknesses; }
+    const PooledArray<sf::Color>& getSideColors() const { return sideColors; }
+    void setSides(const PooledArray<float>& thick, const PooledArray<sf::Color>& colors);
+    // Вершины в координатах сцены: кэш, если он верен, иначе они считаются в scratch.
+    // Кэш пересчитывает refreshWorld после смены мировой матрицы или геометрии
+    const std::vector<sf::Vector2f>& getWorldVertices(std::vector<sf::Vector2f>& scratch) const;
+    void refreshWorld() override;
 
     void addVertex(const sf::Vector2f& pos) override;
     void removeVertex(size_t index) override;
+    // Вставляет вершину, деля сторону index-1; новая сторона наследует её толщину и цвет
+    void insertVertex(size_t index, const sf::Vector2f& pos) override;
+
+    // Ближайшая к point (координаты сцены) сторона не дальше maxDistance, -1 если нет.
+    // localPoint — ближайшая точка стороны в локальных координатах
+    long findNearestSide(const sf::Vector2f& point, float maxDistance, sf::Vector2f& localPoint) const;
 
-    void serialize(std::ostream& out) const override;
-    void deserialize(std::istream& in) override;
+    void readBinary(SceneReader& in) override;
 
-    std::string getTypeName() const { return "Polyline"; }
+    std::string_view getTypeName() const { return "Polyline"; }
 
 
 protected:
-    std::vector<float> thicknesses;
-    std::vector<sf::Color> sideColors;
+    void onVerticesChanged() override { sideIndexDirty = true; localBoundsDirty = true; worldDirty = true; }
+    // Рамка вершин и самая толстая сторона из кэша, а если он устарел — посчитанные заново
+    void localExtent(sf::FloatRect& box, float& thickest) const;
+    void refreshLocalBounds();
+    bool worldVerticesCached() const;
+    sf::FloatRect transformedBounds(const sf::Transform& t, float margin) const;
+    void appendTriangles(const std::vector<sf::Vector2f>& points, float worldScale, sf::VertexArray& out) const;
+
+    PooledArray<float> thicknesses;
+    PooledArray<sf::Color> sideColors;
+    // Сетку сторон строит refreshWorld, и только у длинных ломаных: у коротких, как и
+    // пока сетка устарела, поиск строит временную
+    static constexpr size_t IndexedSides = 64;
+    SegmentIndex sideIndex;
+    bool sideIndexDirty = true;
+    // Рамка вершин в локальных координатах и максимальная толщина
+    sf::FloatRect localBounds;
+    float maxThickness = 0.f;
+    bool localBoundsDirty = true;
+    // Кэш мировых вершин и рамки; worldStamp — метка матрицы, по которой они считались
+    std::vector<sf::Vector2f> worldVertices;
+    sf::FloatRect worldBounds;
+    uint64_t worldStamp = 0;
+    bool worldDirty = true;
 };
\ No newline at end of file
@@ -4,5 +4,5 @@
 class Rectangle : public PolylineFigure {
 public:
     Rectangle(float width, float height, const sf::Color& color, const std::vector<float>& thicknesses);
-    std::string getTypeName() const { return "Rectangle"; }
+    std::string_view getTypeName() const { return "Rectangle"; }
 };
\ No newline at end of file
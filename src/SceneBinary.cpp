@@ -0,0 +1,224 @@
+#include "SceneBinary.hpp"
+#include "SceneSnapshot.hpp"
+#include "FigureManager.hpp"
+#include <unordered_map>
+#include <algorithm>
+#include <iostream>
+
+using TypeIndex = std::unordered_map<std::string_view, uint32_t>;
+
+// Буфер уходит в поток кусками такого размера
+static constexpr size_t FlushSize = 1 << 20;
+
+bool SceneBinary::isBinaryName(std::string_view filename) {
+    return filename.size() >= Extension.size() &&
+           filename.substr(filename.size() - Extension.size()) == Extension;
+}
+
+static void writeRecord(ByteWriter& out, const SceneSnapshot& scene, const TypeIndex& types,
+                        const FigureRecord& rec) {
+    size_t frame = out.beginFrame();
+    out.u8(uint8_t(rec.kind));
+    out.u32(types.at(rec.typeName));
+    out.str(rec.customName);
+    out.vec(rec.position);
+    out.vec(rec.scale);
+    out.f32(rec.rotation);
+    out.vec(rec.pivot);
+    out.color(rec.fill);
+    out.u8(rec.filled);
+
+    switch (rec.kind) {
+        case FigureKind::Polyline: {
+            // Недостающие толщины и цвета — как в текстовом формате
+            size_t n = rec.vertices ? rec.vertices->size() : 0;
+            auto thickness = [&](size_t i) {
+                return rec.thicknesses && i < rec.thicknesses->size() ? (*rec.thicknesses)[i] : 2.0f;
+            };
+            out.u32(uint32_t(n));
+            // Рамка считается так же, как PolylineFigure::localExtent
+            sf::Vector2f min, max;
+            float maxThickness = 0.f;
+            for (size_t i = 0; i < n; ++i) {
+                sf::Vector2f v = (*rec.vertices)[i];
+                if (i == 0) min = max = v;
+                min.x = std::min(min.x, v.x);
+                min.y = std::min(min.y, v.y);
+                max.x = std::max(max.x, v.x);
+                max.y = std::max(max.y, v.y);
+                maxThickness = i == 0 ? thickness(i) : std::max(maxThickness, thickness(i));
+            }
+            out.vec(min);
+            out.vec(max - min);
+            out.f32(maxThickness);
+            out.align(SceneBinary::ArrayAlignment);
+            if (n) out.array(rec.vertices->data(), n, sizeof(float));
+            if (rec.thicknesses && rec.thicknesses->size() >= n) {
+                out.array(rec.thicknesses->data(), n, sizeof(float));
+            } else {
+                for (size_t i = 0; i < n; ++i) out.f32(thickness(i));
+            }
+            if (rec.sideColors && rec.sideColors->size() >= n) {
+                out.array(rec.sideColors->data(), n, 1);
+            } else {
+                for (size_t i = 0; i < n; ++i)
+                    out.color(rec.sideColors && i < rec.sideColors->size() ? (*rec.sideColors)[i] : sf::Color::White);
+            }
+            break;
+        }
+        case FigureKind::Circle:
+            out.f32(rec.radius);
+            out.color(rec.outline);
+            out.f32(rec.outlineThickness);
+            break;
+        case FigureKind::Composite: {
+            size_t count = rec.children ? rec.children->size() : 0;
+            out.u32(uint32_t(count));
+            for (size_t i = 0; i < count; ++i) {
+                const FigureRecord::Child& child = (*rec.children)[i];
+                out.vec(child.offset);
+                writeRecord(out, scene, types, *scene.find(child.id));
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    out.endFrame(frame);
+}
+
+void SceneBinary::write(const SceneSnapshot& scene, std::ostream& stream) {
+    std::vector<std::string_view> names;
+    TypeIndex types;
+    uint64_t vertices = 0;
+    scene.forEach([&](const FigureRecord& rec) {
+        if (types.emplace(rec.typeName, uint32_t(names.size())).second) names.push_back(rec.typeName);
+        if (rec.kind == FigureKind::Polyline && rec.vertices) vertices += rec.vertices->size();
+    });
+
+    std::string buffer;
+    ByteWriter out(buffer);
+    size_t counts = writeHeader(out, names, Indexed);
+    auto top = scene.topLevel();
+    writeCounts(out, counts, top.size(), scene.size(), vertices);
+    std::vector<uint64_t> offsets;
+    offsets.reserve(top.size());
+    for (const FigureRecord* rec : top) {
+        offsets.push_back(out.offset());
+        writeRecord(out, scene, types, *rec);
+        if (buffer.size() >= FlushSize) out.flush(stream);
+    }
+    out.align(ArrayAlignment);
+    uint64_t index = out.offset();
+    out.array(offsets.data(), offsets.size(), sizeof(uint64_t));
+    out.u64(index);
+    out.flush(stream);
+}
+
+size_t SceneBinary::writeHeader(ByteWriter& out, const std::vector<std::string_view>& types, uint32_t flags) {
+    out.array(Magic, sizeof Magic, 1);
+    out.u32(Version);
+    out.u32(flags);
+    out.u32(uint32_t(types.size()));
+    for (std::string_view name : types) out.str(name);
+    size_t at = out.size();
+    for (int i = 0; i < 3; ++i) out.u64(0);
+    return at;
+}
+
+void SceneBinary::writeCounts(ByteWriter& out, size_t at, uint64_t figures, uint64_t allFigures, uint64_t vertices) {
+    out.patch(at, figures, sizeof figures);
+    out.patch(at + sizeof(uint64_t), allFigures, sizeof allFigures);
+    out.patch(at + 2 * sizeof(uint64_t), vertices, sizeof vertices);
+}
+
+bool SceneReader::readHeader() {
+    char magic[sizeof SceneBinary::Magic];
+    array(magic, sizeof magic, 1);
+    if (!ok() || !std::equal(magic, magic + sizeof magic, SceneBinary::Magic)) return false;
+    version = u32();
+    if (version < 1 || version > SceneBinary::Version) return false;
+    uint32_t flags = version >= 3 ? u32() : 0;
+    uint32_t n = count(sizeof(uint32_t));
+    types.clear();
+    types.reserve(n);
+    for (uint32_t i = 0; i < n; ++i) types.emplace_back(str());
+    figures = u64();
+    allFigures = u64();
+    vertices = u64();
+    // Счётчики из повреждённого файла не должны раздувать резерв памяти:
+    // запись не короче заголовка с пустым именем, вершина — 16 байт
+    const size_t minRecord = 4 + 1 + 4 + 4 + 3 * sizeof(sf::Vector2f) + sizeof(float) + 4 + 1;
+    if (allFigures < figures || allFigures > remaining() / minRecord || vertices > remaining() / 16) fail();
+    reported.assign(types.size(), false);
+    records = position();
+    index = nullptr;
+    // Оглавление, которое не сходится с размером файла, не используется: записи
+    // по-прежнему читаются по порядку
+    if (ok() && (flags & SceneBinary::Indexed) && remaining() >= sizeof(uint64_t)) {
+        uint64_t at = 0;
+        ByteOrder::copy(&at, data() + size() - sizeof at, sizeof at, sizeof at);
+        // figures уже ограничено размером файла, произведение не переполняется
+        size_t last = size() - sizeof at;
+        if (at >= size_t(records - data()) && at % sizeof at == 0 && at <= last && last - at == figures * sizeof at)
+            index = data() + at;
+    }
+    return ok();
+}
+
+std::unique_ptr<AbstractFigure> SceneReader::readFigure() {
+    uint32_t length = u32();
+    if (length > remaining()) {
+        fail();
+        return nullptr;
+    }
+    const char* end = position() + length;
+    auto kind = FigureKind(u8());
+    uint32_t type = u32();
+    if (type >= types.size()) {
+        fail();
+        return nullptr;
+    }
+    auto fig = FigureManager::instance().create(types[type]);
+    if (!fig || fig->getKind() != kind) {
+        if (!reported[type]) {
+            std::cerr << "Unknown figure type: " << types[type] << std::endl;
+            reported[type] = true;
+        }
+        seek(end);
+        return nullptr;
+    }
+    fig->readBinary(*this);
+    if (!ok() || position() != end) {
+        fail();
+        return nullptr;
+    }
+    return fig;
+}
+
+void SceneReader::skipFigure() {
+    uint32_t length = u32();
+    if (length > remaining()) fail();
+    else seek(position() + length);
+}
+
+bool SceneReader::seekFigure(uint64_t n) {
+    if (!ok() || n > figures) return false;
+    if (!index) {
+        seek(records);
+        for (uint64_t i = 0; i < n && ok(); ++i) skipFigure();
+        return ok();
+    }
+    uint64_t at = uint64_t(index - data());
+    if (n < figures) ByteOrder::copy(&at, index + n * sizeof at, sizeof at, sizeof at);
+    if (at < uint64_t(records - data()) || at > uint64_t(index - data())) {
+        fail();
+        return false;
+    }
+    seek(data() + at);
+    return true;
+}
+
+bool SceneReader::borrowsGeometry() const {
+    return owner && ByteOrder::Little && version >= 2;
+}
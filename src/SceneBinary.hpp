@@ -0,0 +1,96 @@
+#pragma once
+#include "ByteStream.hpp"
+#include "GeometryPool.hpp"
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <ostream>
+
+class AbstractFigure;
+class SceneSnapshot;
+
+// Двоичный формат сцены (.spb), числа little-endian:
+//   "SPB\0", версия u32, флаги u32, таблица типов (u32 число, строки с длиной), u64 число
+//   фигур верхнего уровня, u64 число всех фигур и u64 число всех вершин (для резерва
+//   памяти), затем записи фигур верхнего уровня по порядку отрисовки.
+// С флагом Indexed после записей идут нули до смещения, кратного 8, оглавление —
+//   смещения записей верхнего уровня от начала файла (u64 на запись) — и последним
+//   u64 смещение самого оглавления: запись N находится без чтения предыдущих.
+// Запись: u32 длина тела, тело — u8 вид, u32 номер типа, имя (строка, пустая — не задано),
+//   позиция, масштаб (2 f32), поворот f32, пивот (2 f32), заливка RGBA, u8 залита,
+//   дальше по виду: ломаная — u32 n, рамка вершин (левый верхний угол и размер),
+//   наибольшая толщина f32, нули до смещения от начала файла, кратного 8,
+//   n вершин, n толщин, n цветов RGBA;
+//   круг — радиус, цвет и толщина контура; группа — u32 число детей,
+//   для каждого смещение (2 f32) и его запись целиком.
+// Массивы вершин выровнены, поэтому отображённый в память файл можно не копировать:
+// фигуры ссылаются на них прямо в отображении. Запись неизвестного типа пропускается
+// по её длине. В версии 1 не было рамки и выравнивания, до версии 3 — флагов и оглавления
+namespace SceneBinary {
+    constexpr char Magic[4] = {'S', 'P', 'B', '\0'};
+    constexpr uint32_t Version = 3;
+    // Флаги заголовка
+    constexpr uint32_t Indexed = 1;
+    constexpr size_t ArrayAlignment = 8;
+    constexpr std::string_view Extension = ".spb";
+
+    // Выбирается ли двоичный формат для этого имени файла
+    bool isBinaryName(std::string_view filename);
+    void write(const SceneSnapshot& scene, std::ostream& out);
+    // Заголовок с нулевыми счётчиками; возвращает их место для writeCounts
+    size_t writeHeader(ByteWriter& out, const std::vector<std::string_view>& types, uint32_t flags = 0);
+    void writeCounts(ByteWriter& out, size_t at, uint64_t figures, uint64_t allFigures, uint64_t vertices);
+}
+
+// Чтение записей фигур: буфер файла и его таблица типов
+class SceneReader : public ByteReader {
+public:
+    // owner держит буфер (отображённый файл): тогда массивы геометрии не копируются,
+    // а ссылаются на него. Начало буфера должно быть выровнено по ArrayAlignment
+    SceneReader(const char* data, size_t size, std::shared_ptr<const void> owner = nullptr)
+        : ByteReader(data, size), owner(std::move(owner)) {}
+
+    // Заголовок файла; false — не тот формат или неизвестная версия
+    bool readHeader();
+    uint64_t figureCount() const { return figures; }
+    // Вместе с вложенными
+    uint64_t totalFigures() const { return allFigures; }
+    uint64_t totalVertices() const { return vertices; }
+    uint32_t formatVersion() const { return version; }
+    // Есть ли оглавление: тогда seekFigure не читает предыдущие записи
+    bool hasIndex() const { return index != nullptr; }
+    // Массивы геометрии берутся из буфера без копирования
+    bool borrowsGeometry() const;
+    // n элементов массива геометрии: ссылкой на буфер или копией
+    template <typename T>
+    void readArray(PooledArray<T>& values, size_t n, size_t width) {
+        if (borrowsGeometry()) {
+            const T* data = view<T>(n);
+            if (data) values.borrow(data, n, owner);
+            return;
+        }
+        values.resize(n);
+        if (n > 0) array(&values[0], n, width);
+    }
+    // Одна запись; nullptr — тип не зарегистрирован (запись пропущена, ok() остаётся
+    // true) или запись повреждена (ok() становится false)
+    std::unique_ptr<AbstractFigure> readFigure();
+    // Пропускает запись по её длине, не разбирая
+    void skipFigure();
+    // Встаёт на запись верхнего уровня n (n == figureCount() — конец записей).
+    // По оглавлению — сразу, без него — перешагивая предыдущие записи
+    bool seekFigure(uint64_t n);
+
+private:
+    std::shared_ptr<const void> owner;
+    std::vector<std::string> types;
+    uint32_t version = 0;
+    // О каждом неизвестном типе сообщается один раз
+    std::vector<bool> reported;
+    const char* records = nullptr;
+    const char* index = nullptr;
+    uint64_t figures = 0;
+    uint64_t allFigures = 0;
+    uint64_t vertices = 0;
+};
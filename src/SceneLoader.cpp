@@ -0,0 +1,252 @@
+#include "SceneLoader.hpp"
+#include "Editor.hpp"
+#include "MappedFile.hpp"
+#include "SceneText.hpp"
+#include "TextStream.hpp"
+#include <SFML/System/Clock.hpp>
+#include <algorithm>
+#include <iostream>
+
+// Столько пачек поток-читатель держит наготове, дальше ждёт
+static constexpr size_t MaxQueued = 8;
+// Столько фигур за раз update кладёт в сцену
+static constexpr size_t PublishFigures = 1024;
+// Куски текста для параллельного разбора: не меньше MinChunk записей,
+// и на поток приходится хотя бы ChunksPerThread кусков
+static constexpr uint64_t MinChunk = 256;
+static constexpr uint64_t ChunksPerThread = 8;
+
+static const char* skipSpaces(const char* p, const char* end) {
+    while (p < end && TextReader::isSpace(*p)) ++p;
+    return p;
+}
+
+SceneLoader::SceneLoader(Editor& editor, const std::string& filename)
+    : editor(editor), binary(SceneBinary::isBinaryName(filename)) {
+    editor.beginLoad();
+    // Виды типов узнаются здесь: создавать фигуры можно только в главном потоке
+    types = SceneText::knownTypes();
+    worker = std::thread(&SceneLoader::readFile, this, filename);
+}
+
+SceneLoader::~SceneLoader() {
+    stop();
+    worker.join();
+    editor.endLoad();
+}
+
+void SceneLoader::readFile(std::string filename) {
+    if (binary) {
+        // Разбирать заранее нечего: записи читаются прямо из отображения
+        if (auto file = MappedFile::open(filename))
+            publish({file, file->data(), file->size(), file->isMapped()});
+    } else if (auto file = MappedFile::open(filename)) {
+        readText(file->data(), file->data() + file->size());
+    }
+    finishReading();
+}
+
+uint64_t SceneLoader::transcode(TextReader& in, uint64_t records, const std::function<bool(Batch)>& emit,
+                                std::string* unknownType) {
+    return SceneText::transcode(in, records, types, [&](std::string&& buffer) {
+        auto batch = std::make_shared<const std::string>(std::move(buffer));
+        return emit({batch, batch->data(), batch->size(), false});
+    }, unknownType, &cancelled);
+}
+
+// Сначала размечаются границы записей верхнего уровня, затем куски подряд идущих
+// записей разбираются в нескольких потоках и уходят в очередь по порядку файла.
+// Кусок годится, только если разобрал ровно свои записи и закончился на начале
+// следующего; иначе с него разбор продолжается последовательно, как обычная загрузка
+void SceneLoader::readText(const char* begin, const char* end) {
+    TextReader head(begin, end);
+    uint64_t count;
+    if (!(head >> count)) return;
+    total = count;
+
+    // Одно ядро оставляем главному потоку; с одним разбирающим потоком разметка
+    // только задержала бы первые фигуры, и весь файл читается последовательно
+    unsigned cores = std::thread::hardware_concurrency();
+    unsigned threads = cores > 1 ? cores - 1 : 1;
+    std::vector<const char*> starts{head.position()};
+    if (threads > 1) starts = SceneText::recordStarts(head.position(), end, count, types);
+    uint64_t indexed = starts.size() - 1;
+    uint64_t chunkSize = std::clamp<uint64_t>(indexed / (threads * ChunksPerThread), MinChunk, SceneText::BatchFigures);
+    size_t chunkCount = size_t((indexed + chunkSize - 1) / chunkSize);
+
+    struct Chunk {
+        std::vector<Batch> batches;
+        bool ok = false;
+        bool ready = false;
+    };
+    std::vector<Chunk> chunks(chunkCount);
+    std::mutex chunkMutex;
+    std::condition_variable chunkChanged;
+    size_t nextChunk = 0, taken = 0;
+    bool stopChunks = false;
+    // Разобранные впрок куски держат память: потоки не уходят дальше окна
+    const size_t window = 4 * threads;
+
+    auto parseChunks = [&] {
+        for (;;) {
+            size_t j;
+            {
+                std::unique_lock<std::mutex> lock(chunkMutex);
+                chunkChanged.wait(lock, [&] { return stopChunks || nextChunk >= chunkCount || nextChunk < taken + window; });
+                if (stopChunks || nextChunk >= chunkCount) return;
+                j = nextChunk++;
+            }
+            uint64_t first = j * chunkSize, last = std::min(indexed, first + chunkSize);
+            TextReader in(starts[first], starts[last]);
+            Chunk chunk;
+            uint64_t done = transcode(in, last - first, [&](Batch batch) {
+                chunk.batches.push_back(std::move(batch));
+                return true;
+            });
+            chunk.ok = done == last - first && skipSpaces(in.position(), starts[last]) == starts[last];
+            chunk.ready = true;
+            {
+                std::lock_guard<std::mutex> lock(chunkMutex);
+                chunks[j] = std::move(chunk);
+            }
+            chunkChanged.notify_all();
+        }
+    };
+    std::vector<std::thread> parsers;
+    for (unsigned i = 0; i < threads && i < chunkCount; ++i) parsers.emplace_back(parseChunks);
+
+    // Куски уходят в очередь по порядку; с первого негодного — последовательный разбор
+    uint64_t resumed = indexed;
+    bool sending = true;
+    for (size_t j = 0; j < chunkCount && sending; ++j) {
+        Chunk chunk;
+        {
+            std::unique_lock<std::mutex> lock(chunkMutex);
+            chunkChanged.wait(lock, [&] { return chunks[j].ready; });
+            chunk = std::move(chunks[j]);
+            taken = j + 1;
+        }
+        chunkChanged.notify_all();
+        if (!chunk.ok) {
+            resumed = j * chunkSize;
+            break;
+        }
+        for (Batch& batch : chunk.batches) {
+            if (!publish(std::move(batch))) {
+                sending = false;
+                break;
+            }
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(chunkMutex);
+        stopChunks = true;
+    }
+    chunkChanged.notify_all();
+    for (std::thread& parser : parsers) parser.join();
+    if (!sending || cancelled || resumed == count) return;
+
+    TextReader in(starts[resumed], end);
+    std::string unknownType;
+    transcode(in, count - resumed, [&](Batch batch) { return publish(std::move(batch)); }, &unknownType);
+    if (!unknownType.empty()) std::cerr << "Unknown figure type: " << unknownType << std::endl;
+}
+
+bool SceneLoader::publish(Batch batch) {
+    std::unique_lock<std::mutex> lock(mutex);
+    queueChanged.wait(lock, [&] { return queue.size() < MaxQueued || cancelled; });
+    if (cancelled) return false;
+    queue.push_back(std::move(batch));
+    return true;
+}
+
+void SceneLoader::finishReading() {
+    std::lock_guard<std::mutex> lock(mutex);
+    readingDone = true;
+}
+
+bool SceneLoader::nextBatch() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (queue.empty()) return false;
+        current = std::move(queue.front());
+        queue.pop_front();
+    }
+    queueChanged.notify_one();
+    reader.emplace(current.data, current.size, current.mapped ? current.keep : nullptr);
+    if (!reader->readHeader()) {
+        std::cerr << "Unsupported scene file" << std::endl;
+        failed = true;
+        return false;
+    }
+    left = reader->figureCount();
+    if (binary) {
+        total = reader->figureCount();
+        editor.reserve(total, reader->totalFigures(), reader->borrowsGeometry() ? 0 : reader->totalVertices());
+    } else if (published == 0) {
+        // Из текста известно только число фигур верхнего уровня
+        editor.reserve(total, total, 0);
+    }
+    return true;
+}
+
+void SceneLoader::update(sf::Time budget) {
+    if (isDone() || editor.isChanging()) return;
+    sf::Clock clock;
+    std::vector<std::unique_ptr<AbstractFigure>> figs;
+    while (clock.getElapsedTime() < budget) {
+        if (!reader && !nextBatch()) break;
+        if (left == 0) {
+            reader.reset();
+            current = Batch();
+            continue;
+        }
+        --left;
+        auto fig = reader->readFigure();
+        // Как при обычной загрузке: запись неизвестного типа пропускается,
+        // на повреждённой загрузка заканчивается
+        if (!fig) {
+            if (reader->ok()) {
+                ++skipped;
+                continue;
+            }
+            failed = true;
+            break;
+        }
+        figs.push_back(std::move(fig));
+        // Вставка в сцену тоже входит в бюджет кадра
+        if (figs.size() == PublishFigures) {
+            published += figs.size();
+            editor.appendLoaded(figs);
+        }
+    }
+    published += figs.size();
+    editor.appendLoaded(figs);
+    if (failed) stop();
+}
+
+float SceneLoader::getProgress() const {
+    uint64_t expected = total;
+    return expected == 0 ? 0.f : std::min(1.f, float(published + skipped) / float(expected));
+}
+
+bool SceneLoader::isDone() const {
+    if (cancelled || failed) return true;
+    std::lock_guard<std::mutex> lock(mutex);
+    return readingDone && queue.empty() && !reader;
+}
+
+void SceneLoader::cancel() {
+    stop();
+}
+
+void SceneLoader::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        cancelled = true;
+        queue.clear();
+    }
+    queueChanged.notify_all();
+    reader.reset();
+    current = Batch();
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include "AbstractFigure.hpp"
+#include "SceneBinary.hpp"
+#include "SceneText.hpp"
+#include <SFML/System/Time.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+class Editor;
+class TextReader;
+
+// Загрузка сцены в фоне. Поток-читатель разбирает файл и готовит пачки записей
+// в двоичном формате; фигуры из них создаёт главный поток в update, понемногу за кадр,
+// потому что хранилище фигур и пулы геометрии однопоточные. Уже загруженная часть
+// сразу лежит в сцене целыми фигурами верхнего уровня в порядке файла.
+// Двоичный файл не разбирается заранее: он отображается в память и читается по месту.
+// Текстовый на многоядерной машине разбирается кусками в нескольких потоках
+class SceneLoader {
+public:
+    // Убирает прежнюю сцену в правку загрузки (Editor::beginLoad) и запускает чтение
+    SceneLoader(Editor& editor, const std::string& filename);
+    // Отменяет загрузку, дожидается потока и кладёт загрузку в историю
+    ~SceneLoader();
+
+    SceneLoader(const SceneLoader&) = delete;
+    SceneLoader& operator=(const SceneLoader&) = delete;
+
+    // Переносит в сцену готовые фигуры, тратя не больше budget. Пока у редактора
+    // открыта правка (например, идёт перетаскивание), ничего не делает
+    void update(sf::Time budget);
+    // Доля перенесённых фигур верхнего уровня, 0..1
+    float getProgress() const;
+    // Всё перенесено, загрузка отменена или файл оказался повреждён
+    bool isDone() const;
+    // Перенесённые фигуры остаются в сцене
+    void cancel();
+
+private:
+    // Кусок файла в двоичном формате: заголовок и записи фигур верхнего уровня
+    struct Batch {
+        std::shared_ptr<const void> keep;   // владелец памяти
+        const char* data = nullptr;
+        size_t size = 0;
+        bool mapped = false;                // отображённый файл: геометрию можно не копировать
+    };
+
+    void readFile(std::string filename);
+    void readText(const char* begin, const char* end);
+    // Переводит до records текстовых записей из in в пачки и отдаёт их emit;
+    // false из emit прекращает работу. Возвращает число переведённых записей
+    uint64_t transcode(TextReader& in, uint64_t records, const std::function<bool(Batch)>& emit,
+                       std::string* unknownType = nullptr);
+    // Ждёт места в очереди; false — загрузка отменена
+    bool publish(Batch batch);
+    void finishReading();
+    // Следующая пачка из очереди; false — пока нечего читать
+    bool nextBatch();
+    void stop();
+
+    Editor& editor;
+    bool binary;
+    // Типы, известные на момент начала загрузки, и их виды: их читает поток-читатель
+    SceneText::Types types;
+
+    std::thread worker;
+    mutable std::mutex mutex;
+    std::condition_variable queueChanged;
+    std::deque<Batch> queue;
+    bool readingDone = false;
+    std::atomic<bool> cancelled{false};
+    std::atomic<uint64_t> total{0};
+
+    // Состояние главного потока
+    Batch current;
+    std::optional<SceneReader> reader;
+    uint64_t left = 0;                      // записей, оставшихся в текущей пачке
+    uint64_t published = 0;
+    uint64_t skipped = 0;                   // записи неизвестных типов
+    bool failed = false;
+};
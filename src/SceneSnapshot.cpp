@@ -0,0 +1,143 @@
+#include "SceneSnapshot.hpp"
+#include "FigureVisit.hpp"
+#include "TextStream.hpp"
+#include <algorithm>
+
+// Копия массива для записи; если содержимое не изменилось, берётся прежняя
+template <typename T>
+static std::shared_ptr<const std::vector<T>> share(const PooledArray<T>& values,
+                                                   const std::shared_ptr<const std::vector<T>>& previous) {
+    if (values.empty()) return nullptr;
+    if (previous && previous->size() == values.size() && std::equal(values.begin(), values.end(), previous->begin()))
+        return previous;
+    return std::make_shared<const std::vector<T>>(values.begin(), values.end());
+}
+
+std::shared_ptr<const FigureRecord> FigureRecord::capture(const AbstractFigure& fig, bool nested, uint64_t z,
+                                                          const FigureRecord* previous) {
+    static const FigureRecord none;
+    if (!previous) previous = &none;
+
+    auto rec = std::make_shared<FigureRecord>();
+    FigureStore& store = FigureStore::instance();
+    EntityId id = fig.getEntity();
+    rec->id = id;
+    rec->kind = fig.getKind();
+    rec->typeName = fig.getTypeName();
+    Symbol custom = store.customName(id);
+    if (custom) rec->customName = SymbolTable::instance().name(custom);
+    rec->nested = nested;
+    rec->z = z;
+    rec->position = fig.getPosition();
+    rec->scale = fig.getScaleXY();
+    rec->pivot = fig.getLocalPivot();
+    rec->rotation = fig.getRotation();
+    rec->fill = fig.getFillColor();
+    rec->filled = fig.isFilled();
+    rec->vertices = share(fig.getVertices(), previous->vertices);
+
+    struct Extra {
+        FigureRecord& rec;
+        const FigureRecord& previous;
+        void operator()(const PolylineFigure& poly) const {
+            rec.thicknesses = share(poly.getThicknesses(), previous.thicknesses);
+            rec.sideColors = share(poly.getSideColors(), previous.sideColors);
+        }
+        void operator()(const Circle& circle) const {
+            rec.radius = circle.getBaseRadius();
+            rec.outline = circle.getOutlineColor();
+            rec.outlineThickness = circle.getOutlineThickness();
+        }
+        void operator()(const CompositeFigure& comp) const {
+            std::vector<Child> children(comp.getChildCount());
+            for (size_t i = 0; i < children.size(); ++i)
+                children[i] = {comp.getChild(i)->getEntity(), comp.getChildOffset(i)};
+            const auto& old = previous.children;
+            bool same = old && old->size() == children.size() &&
+                        std::equal(children.begin(), children.end(), old->begin(), [](const Child& a, const Child& b) {
+                            return a.id == b.id && a.offset == b.offset;
+                        });
+            rec.children = same ? old : std::make_shared<const std::vector<Child>>(std::move(children));
+        }
+        void operator()(const AbstractFigure&) const {}
+    };
+    visitFigure(fig, Extra{*rec, *previous});
+    return rec;
+}
+
+const FigureRecord* SceneSnapshot::find(EntityId id) const {
+    const auto* rec = records.find(id);
+    return rec ? rec->get() : nullptr;
+}
+
+std::vector<const FigureRecord*> SceneSnapshot::topLevel() const {
+    std::vector<const FigureRecord*> result;
+    records.forEach([&](EntityId, const std::shared_ptr<const FigureRecord>& rec) {
+        if (!rec->nested) result.push_back(rec.get());
+    });
+    std::sort(result.begin(), result.end(), [](const FigureRecord* a, const FigureRecord* b) { return a->z < b->z; });
+    return result;
+}
+
+// Текст копится в буфере и уходит в поток крупными кусками
+static constexpr size_t FlushBytes = 1 << 20;
+
+void SceneSnapshot::save(std::ostream& out) const {
+    auto top = topLevel();
+    std::string buffer;
+    TextWriter text(buffer);
+    text << top.size() << '\n';
+    for (const FigureRecord* rec : top) {
+        write(text, *rec);
+        if (text.size() >= FlushBytes) text.flush(out);
+    }
+    text.flush(out);
+}
+
+// Запись фигуры: строка типа, строка имени, строка общих полей и строки своего вида;
+// у группы после каждого ребёнка идёт строка его смещения
+void SceneSnapshot::write(TextWriter& out, const FigureRecord& rec) const {
+    out << rec.typeName << '\n';
+    out << (rec.customName.empty() ? rec.typeName : rec.customName) << "\n";
+    out.vec(rec.position) << ' ' << rec.scale.x << ' ';
+    out.color(rec.fill) << ' ' << rec.filled << ' ';
+    out.vec(rec.pivot);
+    if (rec.rotation != 0.f || rec.scale.y != rec.scale.x)
+        out << " R " << rec.rotation << ' ' << rec.scale.y;
+    out << '\n';
+
+    switch (rec.kind) {
+        case FigureKind::Polyline: {
+            size_t n = rec.vertices ? rec.vertices->size() : 0;
+            size_t thick = rec.thicknesses ? rec.thicknesses->size() : 0;
+            size_t colors = rec.sideColors ? rec.sideColors->size() : 0;
+            out << n << '\n';
+            for (size_t i = 0; i < n; ++i)
+                out.vec((*rec.vertices)[i]) << ' ';
+            out << '\n';
+            for (size_t i = 0; i < n; ++i)
+                out << (i < thick ? (*rec.thicknesses)[i] : 2.0f) << ' ';
+            out << '\n';
+            for (size_t i = 0; i < n; ++i) {
+                sf::Color c = i < colors ? (*rec.sideColors)[i] : sf::Color::White;
+                out.color(c) << ' ';
+            }
+            out << '\n';
+            break;
+        }
+        case FigureKind::Circle:
+            out << rec.radius << ' ';
+            out.color(rec.outline) << ' ' << rec.outlineThickness << '\n';
+            break;
+        case FigureKind::Composite:
+            out << (rec.children ? rec.children->size() : 0) << '\n';
+            if (!rec.children) break;
+            for (const FigureRecord::Child& child : *rec.children) {
+                write(out, *find(child.id));
+                out.vec(child.offset) << '\n';
+            }
+            break;
+        default:
+            break;
+    }
+}
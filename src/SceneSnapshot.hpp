@@ -0,0 +1,71 @@
+#pragma once
+#include "AbstractFigure.hpp"
+#include "PersistentMap.hpp"
+#include <memory>
+#include <vector>
+#include <string_view>
+#include <ostream>
+
+class TextWriter;
+
+// Неизменяемая запись о фигуре на момент снимка. Имена указывают в SymbolTable
+// (строки там живут до конца программы), массивы геометрии делятся между
+// записями одной фигуры, пока не меняются
+struct FigureRecord {
+    struct Child {
+        EntityId id;
+        sf::Vector2f offset;
+    };
+
+    EntityId id = 0;
+    FigureKind kind = FigureKind::Other;
+    std::string_view typeName, customName;   // пустое customName — имя не задано
+    bool nested = false;
+    uint64_t z = 0;                          // ключ порядка отрисовки фигуры верхнего уровня
+    sf::Vector2f position, scale, pivot;
+    float rotation = 0.f;
+    sf::Color fill;
+    bool filled = false;
+    std::shared_ptr<const std::vector<sf::Vector2f>> vertices;
+    // PolylineFigure
+    std::shared_ptr<const std::vector<float>> thicknesses;
+    std::shared_ptr<const std::vector<sf::Color>> sideColors;
+    // Circle
+    float radius = 0.f;
+    sf::Color outline;
+    float outlineThickness = 0.f;
+    // CompositeFigure
+    std::shared_ptr<const std::vector<Child>> children;
+
+    // Запись по текущему состоянию fig; массивы, совпавшие с previous, берутся оттуда
+    static std::shared_ptr<const FigureRecord> capture(const AbstractFigure& fig, bool nested, uint64_t z,
+                                                       const FigureRecord* previous);
+};
+
+using RecordMap = PersistentMap<std::shared_ptr<const FigureRecord>>;
+
+// Сцена на момент снимка. Копия — O(1), редактор при этом правит сцену дальше;
+// снимок можно читать и сохранять из другого потока
+class SceneSnapshot {
+public:
+    SceneSnapshot() = default;
+    explicit SceneSnapshot(RecordMap records) : records(std::move(records)) {}
+
+    // Все фигуры, включая вложенные
+    size_t size() const { return records.size(); }
+    const FigureRecord* find(EntityId id) const;
+    // Фигуры верхнего уровня по порядку отрисовки
+    std::vector<const FigureRecord*> topLevel() const;
+    // fn(record) для всех записей в произвольном порядке
+    template <typename Fn>
+    void forEach(Fn&& fn) const {
+        records.forEach([&](EntityId, const std::shared_ptr<const FigureRecord>& rec) { fn(*rec); });
+    }
+    // Текстовый формат сцены; другого писателя у него нет
+    void save(std::ostream& out) const;
+
+private:
+    void write(TextWriter& out, const FigureRecord& rec) const;
+
+    RecordMap records;
+};
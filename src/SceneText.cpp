@@ -0,0 +1,263 @@
+#include "SceneText.hpp"
+#include "FigureManager.hpp"
+#include "SceneBinary.hpp"
+#include "TextStream.hpp"
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <unordered_map>
+
+namespace {
+
+// Переводит текстовые записи фигур в двоичные
+class TextTranscoder {
+public:
+    TextTranscoder(TextReader& in, const std::vector<std::string>& names, const std::vector<FigureKind>& kinds)
+        : in(in), kinds(kinds) {
+        for (uint32_t i = 0; i < names.size(); ++i) index.emplace(names[i], i);
+    }
+
+    // Одна фигура с детьми; false — конец данных, ошибка разбора или неизвестный тип
+    bool record(ByteWriter& out) {
+        std::string type;
+        if (!(in >> type)) return false;
+        auto found = index.find(type);
+        if (found == index.end()) {
+            unknownType = type;
+            return false;
+        }
+        FigureKind kind = kinds[found->second];
+        size_t frame = out.beginFrame();
+        out.u8(uint8_t(kind));
+        out.u32(found->second);
+
+        // Общие поля
+        std::string name;
+        sf::Vector2f position, pivot;
+        float scale;
+        int r, g, b;
+        bool filled;
+        in.line(name) >> position.x >> position.y >> scale >> r >> g >> b >> filled >> pivot.x >> pivot.y;
+        float rotation = 0.f, scaleY = scale;
+        if (in.consume('R')) in >> rotation >> scaleY;
+        out.str(name);
+        out.vec(position);
+        out.vec({scale, scaleY});
+        out.f32(rotation);
+        out.vec(pivot);
+        out.color(sf::Color(r, g, b));
+        out.u8(filled);
+
+        switch (kind) {
+            case FigureKind::Polyline:
+                if (!polyline(out)) return false;
+                break;
+            case FigureKind::Circle: {
+                float radius, thickness;
+                in >> radius >> r >> g >> b >> thickness;
+                out.f32(radius);
+                out.color(sf::Color(r, g, b));
+                out.f32(thickness);
+                break;
+            }
+            case FigureKind::Composite: {
+                // В тексте смещение идёт после записи ребёнка, в двоичном формате — перед ней
+                size_t count;
+                if (!(in >> count) || count > UINT32_MAX) return false;
+                out.u32(uint32_t(count));
+                for (size_t i = 0; i < count; ++i) {
+                    size_t at = out.size();
+                    out.vec({});
+                    if (!record(out)) return false;
+                    sf::Vector2f offset;
+                    in >> offset.x >> offset.y;
+                    out.patch(at, offset, sizeof(float));
+                }
+                break;
+            }
+            default:
+                break;
+        }
+        if (!in) return false;
+        out.endFrame(frame);
+        ++figures;
+        return true;
+    }
+
+    // Счётчики для заголовка пачки
+    uint64_t figures = 0;
+    uint64_t vertices = 0;
+    // Тип, на котором остановился разбор
+    std::string unknownType;
+
+private:
+    // Рамка вершин считается по ходу и вписывается перед массивами
+    bool polyline(ByteWriter& out) {
+        size_t n;
+        if (!(in >> n) || n > UINT32_MAX) return false;
+        out.u32(uint32_t(n));
+        size_t boundsAt = out.size();
+        out.vec({});
+        out.vec({});
+        out.f32(0.f);
+        out.align(SceneBinary::ArrayAlignment);
+        sf::Vector2f min, max;
+        for (size_t i = 0; i < n && in; ++i) {
+            sf::Vector2f v;
+            in >> v.x >> v.y;
+            out.vec(v);
+            if (i == 0) min = max = v;
+            min.x = std::min(min.x, v.x);
+            min.y = std::min(min.y, v.y);
+            max.x = std::max(max.x, v.x);
+            max.y = std::max(max.y, v.y);
+        }
+        float thickest = 0.f;
+        for (size_t i = 0; i < n && in; ++i) {
+            float t;
+            in >> t;
+            out.f32(t);
+            thickest = i == 0 ? t : std::max(thickest, t);
+        }
+        for (size_t i = 0; i < n && in; ++i) {
+            int r, g, b;
+            in >> r >> g >> b;
+            out.color(sf::Color(r, g, b));
+        }
+        out.patch(boundsAt, min, sizeof(float));
+        out.patch(boundsAt + sizeof(sf::Vector2f), max - min, sizeof(float));
+        out.patch(boundsAt + 2 * sizeof(sf::Vector2f), thickest, sizeof(float));
+        vertices += n;
+        return bool(in);
+    }
+
+    TextReader& in;
+    const std::vector<FigureKind>& kinds;
+    std::unordered_map<std::string, uint32_t> index;
+};
+
+const char* skipSpaces(const char* p, const char* end) {
+    while (p < end && TextReader::isSpace(*p)) ++p;
+    return p;
+}
+
+const char* nextLine(const char* p, const char* end) {
+    auto* newline = static_cast<const char*>(std::memchr(p, '\n', size_t(end - p)));
+    return newline ? newline + 1 : end;
+}
+
+// Разметка записей по строкам, без разбора чисел: у ломаной четыре строки своего
+// вида, у круга одна, у группы строка с числом детей, затем дети со смещениями
+class RecordIndex {
+public:
+    RecordIndex(const char* end, const std::vector<std::string>& names, const std::vector<FigureKind>& kinds)
+        : end(end) {
+        for (size_t i = 0; i < names.size(); ++i) this->kinds.emplace(names[i], kinds[i]);
+    }
+
+    // Начала подряд идущих записей верхнего уровня с p, не больше count, и в конце —
+    // место сразу за последней. Останавливается на записи, которую не удалось разметить
+    std::vector<const char*> scan(const char* p, uint64_t count) const {
+        std::vector<const char*> starts;
+        p = skipSpaces(p, end);
+        starts.push_back(p);
+        for (uint64_t i = 0; i < count && skip(p); ++i) {
+            p = skipSpaces(p, end);
+            starts.push_back(p);
+        }
+        return starts;
+    }
+
+private:
+    bool skip(const char*& p) const {
+        p = skipSpaces(p, end);
+        const char* word = p;
+        while (p < end && !TextReader::isSpace(*p)) ++p;
+        auto found = kinds.find(std::string_view(word, size_t(p - word)));
+        if (found == kinds.end()) return false;
+        for (int i = 0; i < 3; ++i) p = nextLine(p, end);
+        switch (found->second) {
+            case FigureKind::Polyline:
+                for (int i = 0; i < 4; ++i) p = nextLine(p, end);
+                break;
+            case FigureKind::Circle:
+                p = nextLine(p, end);
+                break;
+            case FigureKind::Composite: {
+                uint64_t count = 0;
+                const char* line = skipSpaces(p, end);
+                if (std::from_chars(line, end, count).ec != std::errc()) return false;
+                p = nextLine(p, end);
+                for (uint64_t i = 0; i < count; ++i) {
+                    if (!skip(p)) return false;
+                    p = nextLine(p, end);
+                }
+                break;
+            }
+            default:
+                break;
+        }
+        return p < end || (p == end && word < end);
+    }
+
+    const char* end;
+    std::unordered_map<std::string_view, FigureKind> kinds;
+};
+
+
+}
+
+namespace SceneText {
+
+Types knownTypes() {
+    Types types;
+    FigureManager& manager = FigureManager::instance();
+    for (const std::string& name : manager.getTypeNames()) {
+        if (auto fig = manager.create(name)) {
+            types.names.push_back(name);
+            types.kinds.push_back(fig->getKind());
+        }
+    }
+    return types;
+}
+
+uint64_t transcode(TextReader& in, uint64_t records, const Types& types,
+                   const std::function<bool(std::string&&)>& emit, std::string* unknownType,
+                   const std::atomic<bool>* cancel) {
+    TextTranscoder transcoder(in, types.names, types.kinds);
+    std::vector<std::string_view> names(types.names.begin(), types.names.end());
+    std::string buffer;
+    ByteWriter out(buffer);
+    size_t counts = 0;
+    uint64_t figures = 0, done = 0;
+    auto send = [&] {
+        SceneBinary::writeCounts(out, counts, figures, transcoder.figures, transcoder.vertices);
+        std::string batch;
+        batch.swap(buffer);
+        figures = transcoder.figures = transcoder.vertices = 0;
+        return emit(std::move(batch));
+    };
+
+    for (; done < records && !(cancel && *cancel); ++done) {
+        if (figures == 0) counts = SceneBinary::writeHeader(out, names);
+        size_t start = buffer.size();
+        uint64_t allFigures = transcoder.figures, vertices = transcoder.vertices;
+        if (!transcoder.record(out)) {
+            buffer.resize(start);
+            transcoder.figures = allFigures;
+            transcoder.vertices = vertices;
+            break;
+        }
+        ++figures;
+        if ((figures == BatchFigures || buffer.size() >= BatchBytes) && !send()) return done + 1;
+    }
+    if (figures > 0) send();
+    if (unknownType) *unknownType = transcoder.unknownType;
+    return done;
+}
+
+std::vector<const char*> recordStarts(const char* p, const char* end, uint64_t count, const Types& types) {
+    return RecordIndex(end, types.names, types.kinds).scan(p, count);
+}
+
+}
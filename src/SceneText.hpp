@@ -0,0 +1,44 @@
+#pragma once
+#include "AbstractFigure.hpp"
+#include <atomic>
+#include <functional>
+#include <string>
+#include <vector>
+
+class TextReader;
+
+// Текстовый формат сцены: число фигур верхнего уровня, затем их записи. Запись —
+// строка типа, строка имени, строка общих полей (позиция, масштаб, заливка, пивот
+// и необязательные " R <поворот> <масштаб по Y>") и строки своего вида: у ломаной
+// число вершин, вершины, толщины и цвета сторон; у круга радиус, цвет и толщина
+// контура; у группы число детей, затем дети, и после каждого строка смещения.
+// Пишет формат только SceneSnapshot::save. Читается он только здесь: записи
+// переводятся в двоичный формат (SceneBinary.hpp), а фигуры из него создаёт
+// SceneReader — так обычная и фоновая загрузка ведут себя на любом файле одинаково
+namespace SceneText {
+    // Пачка transcode: столько фигур или столько байт, что наберётся раньше
+    constexpr size_t BatchFigures = 4096;
+    constexpr size_t BatchBytes = 4 << 20;
+
+    // Имена и виды типов, известных FigureManager. Создаёт по фигуре каждого типа,
+    // поэтому вызывается из главного потока
+    struct Types {
+        std::vector<std::string> names;
+        std::vector<FigureKind> kinds;
+    };
+    Types knownTypes();
+
+    // Переводит до records записей верхнего уровня из in в пачки двоичного формата
+    // (заголовок и записи) и отдаёт их emit; false из emit или поднятый cancel
+    // прекращают работу. Недочитанная запись отбрасывается целиком, разбор
+    // останавливается на ней. Возвращает число переведённых записей; в unknownType —
+    // тип, на котором разбор остановился, если дело в нём
+    uint64_t transcode(TextReader& in, uint64_t records, const Types& types,
+                       const std::function<bool(std::string&&)>& emit, std::string* unknownType = nullptr,
+                       const std::atomic<bool>* cancel = nullptr);
+
+    // Начала подряд идущих записей верхнего уровня с p, не больше count, и в конце —
+    // место сразу за последней. Записи размечаются по строкам, без разбора чисел,
+    // и разметка останавливается на записи, которую разметить не удалось
+    std::vector<const char*> recordStarts(const char* p, const char* end, uint64_t count, const Types& types);
+}
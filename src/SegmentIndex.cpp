@@ -0,0 +1,112 @@
+#include "SegmentIndex.hpp"
+#include <algorithm>
+#include <cmath>
+
+void SegmentIndex::clear() {
+    segmentCount = 0;
+    cols = rows = 0;
+    cellStart.clear();
+    items.clear();
+}
+
+int SegmentIndex::cellX(float x) const {
+    return std::clamp((int)std::floor((x - origin.x) / cellSize), 0, cols - 1);
+}
+
+int SegmentIndex::cellY(float y) const {
+    return std::clamp((int)std::floor((y - origin.y) / cellSize), 0, rows - 1);
+}
+
+void SegmentIndex::build(const sf::Vector2f* points, size_t n) {
+    clear();
+    if (n < 2) return;
+    segmentCount = n;
+
+    float minX = points[0].x, maxX = minX, minY = points[0].y, maxY = minY;
+    double totalLength = 0;
+    for (size_t i = 0; i < n; ++i) {
+        const sf::Vector2f& a = points[i];
+        const sf::Vector2f& b = points[(i + 1) % n];
+        minX = std::min(minX, a.x); maxX = std::max(maxX, a.x);
+        minY = std::min(minY, a.y); maxY = std::max(maxY, a.y);
+        totalLength += std::hypot(b.x - a.x, b.y - a.y);
+    }
+    float width = std::max(maxX - minX, 1e-3f);
+    float height = std::max(maxY - minY, 1e-3f);
+
+    // Ячейка не меньше средней длины стороны, а ячеек не больше ~2n
+    cellSize = std::max((float)(totalLength / n), std::sqrt(width * height / (2.f * n)));
+    cellSize = std::max(cellSize, 1e-3f);
+    cols = std::max(1, (int)std::ceil(width / cellSize));
+    rows = std::max(1, (int)std::ceil(height / cellSize));
+    origin = {minX, minY};
+
+    cellStart.assign((size_t)cols * rows + 1, 0);
+    auto forEachCell = [&](size_t i, auto&& fn) {
+        const sf::Vector2f& a = points[i];
+        const sf::Vector2f& b = points[(i + 1) % n];
+        int x0 = cellX(std::min(a.x, b.x)), x1 = cellX(std::max(a.x, b.x));
+        int y0 = cellY(std::min(a.y, b.y)), y1 = cellY(std::max(a.y, b.y));
+        for (int y = y0; y <= y1; ++y)
+            for (int x = x0; x <= x1; ++x)
+                fn((size_t)y * cols + x);
+    };
+    for (size_t i = 0; i < n; ++i)
+        forEachCell(i, [&](size_t c) { ++cellStart[c + 1]; });
+    for (size_t c = 1; c < cellStart.size(); ++c)
+        cellStart[c] += cellStart[c - 1];
+    items.resize(cellStart.back());
+    std::vector<uint32_t> fill(cellStart.begin(), cellStart.end() - 1);
+    for (size_t i = 0; i < n; ++i)
+        forEachCell(i, [&](size_t c) { items[fill[c]++] = (uint32_t)i; });
+}
+
+// Ближайшая к p точка отрезка ab; t — её параметр на отрезке
+static sf::Vector2f closestOnSegment(const sf::Vector2f& a, const sf::Vector2f& b, const sf::Vector2f& p, float& t) {
+    sf::Vector2f ab = b - a;
+    float len2 = ab.x * ab.x + ab.y * ab.y;
+    t = len2 > 0 ? ((p.x - a.x) * ab.x + (p.y - a.y) * ab.y) / len2 : 0.f;
+    t = std::clamp(t, 0.f, 1.f);
+    return a + ab * t;
+}
+
+template <typename Visit>
+bool SegmentIndex::forEachNear(const sf::Vector2f& p, float radius, Visit&& visit) const {
+    if (p.x < origin.x - radius || p.y < origin.y - radius ||
+        p.x > origin.x + cols * cellSize + radius ||
+        p.y > origin.y + rows * cellSize + radius)
+        return false;
+    int x0 = cellX(p.x - radius), x1 = cellX(p.x + radius);
+    int y0 = cellY(p.y - radius), y1 = cellY(p.y + radius);
+    for (int y = y0; y <= y1; ++y) {
+        for (int x = x0; x <= x1; ++x) {
+            size_t c = (size_t)y * cols + x;
+            for (uint32_t k = cellStart[c]; k < cellStart[c + 1]; ++k) visit(items[k]);
+        }
+    }
+    return true;
+}
+
+long SegmentIndex::nearest(const sf::Vector2f* points, size_t n, const sf::Transform& toWorld,
+                           const sf::Vector2f& worldP, const sf::Vector2f& localP, float searchRadius,
+                           float maxDistance, sf::Vector2f& nearestPoint) const {
+    if (segmentCount == 0 || n != segmentCount) return -1;
+    long best = -1;
+    float bestDist2 = maxDistance * maxDistance;
+    forEachNear(localP, searchRadius, [&](uint32_t i) {
+        // Аффинная матрица сохраняет параметр точки на отрезке: t из мировых
+        // координат даёт ту же точку в локальных
+        const sf::Vector2f& a = points[i];
+        const sf::Vector2f& b = points[(i + 1) % n];
+        float t;
+        sf::Vector2f q = closestOnSegment(toWorld.transformPoint(a), toWorld.transformPoint(b), worldP, t);
+        float dx = q.x - worldP.x, dy = q.y - worldP.y;
+        float d2 = dx * dx + dy * dy;
+        if (d2 < bestDist2 || (d2 == bestDist2 && best < 0)) {
+            bestDist2 = d2;
+            best = i;
+            nearestPoint = a + (b - a) * t;
+        }
+    });
+    return best;
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <SFML/Graphics.hpp>
+#include <vector>
+#include <cstdint>
+
+// Равномерная сетка по сторонам замкнутого контура (сторона i: точка i -> i+1)
+class SegmentIndex {
+public:
+    void build(const sf::Vector2f* points, size_t n);
+    void clear();
+    bool empty() const { return segmentCount == 0; }
+
+    // Ближайшая к worldP сторона не дальше maxDistance; -1, если такой нет.
+    // Расстояния меряются после перевода сторон матрицей toWorld: при неравномерном
+    // масштабе ближайшая в точках сетки не всегда ближайшая на экране. Кандидаты
+    // ищутся вокруг localP в радиусе searchRadius (в точках сетки), он должен
+    // покрывать maxDistance. nearestPoint — в точках сетки
+    long nearest(const sf::Vector2f* points, size_t n, const sf::Transform& toWorld,
+                 const sf::Vector2f& worldP, const sf::Vector2f& localP, float searchRadius,
+                 float maxDistance, sf::Vector2f& nearestPoint) const;
+
+private:
+    int cellX(float x) const;
+    int cellY(float y) const;
+    // Стороны из ячеек, задетых квадратом радиуса radius вокруг p; сторона может
+    // прийти несколько раз. false, если p дальше radius от всей сетки
+    template <typename Visit>
+    bool forEachNear(const sf::Vector2f& p, float radius, Visit&& visit) const;
+
+    sf::Vector2f origin;
+    float cellSize = 1.f;
+    int cols = 0, rows = 0;
+    size_t segmentCount = 0;
+    std::vector<uint32_t> cellStart;    // CSR: стороны ячейки c лежат в items[cellStart[c]..cellStart[c+1])
+    std::vector<uint32_t> items;
+};
@@ -0,0 +1,93 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <utility>
+
+// Идентификатор элемента SlotMap: индекс слота + поколение.
+// После удаления поколение слота растёт, и старые идентификаторы становятся недействительными.
+struct SlotHandle {
+    uint32_t index = UINT32_MAX;
+    uint32_t generation = 0;
+
+    bool isNull() const { return index == UINT32_MAX; }
+    bool operator==(const SlotHandle& other) const {
+        return index == other.index && generation == other.generation;
+    }
+    bool operator!=(const SlotHandle& other) const { return !(*this == other); }
+};
+
+// Растущий массив слотов со списком свободных: вставка, удаление и проверка за O(1)
+template <typename T>
+class SlotMap {
+public:
+    SlotHandle insert(T value) {
+        uint32_t index;
+        if (!freeSlots.empty()) {
+            index = freeSlots.back();
+            freeSlots.pop_back();
+        } else {
+            index = (uint32_t)slots.size();
+            slots.emplace_back();
+        }
+        Slot& slot = slots[index];
+        slot.value = std::move(value);
+        slot.occupied = true;
+        ++count;
+        return {index, slot.generation};
+    }
+
+    bool contains(SlotHandle h) const {
+        return h.index < slots.size() && slots[h.index].occupied &&
+               slots[h.index].generation == h.generation;
+    }
+
+    T* get(SlotHandle h) { return contains(h) ? &slots[h.index].value : nullptr; }
+    const T* get(SlotHandle h) const { return contains(h) ? &slots[h.index].value : nullptr; }
+
+    // Извлекает значение и освобождает слот; h должен быть действительным
+    T take(SlotHandle h) {
+        Slot& slot = slots[h.index];
+        T value = std::move(slot.value);
+        slot.value = T();
+        slot.occupied = false;
+        ++slot.generation;
+        freeSlots.push_back(h.index);
+        --count;
+        return value;
+    }
+
+    bool erase(SlotHandle h) {
+        if (!contains(h)) return false;
+        take(h);
+        return true;
+    }
+
+    // Слоты сохраняются, чтобы выданные ранее идентификаторы не ожили
+    void clear() {
+        freeSlots.clear();
+        for (uint32_t i = (uint32_t)slots.size(); i-- > 0;) {
+            Slot& slot = slots[i];
+            if (slot.occupied) {
+                slot.value = T();
+                slot.occupied = false;
+                ++slot.generation;
+            }
+            freeSlots.push_back(i);
+        }
+        count = 0;
+    }
+
+    size_t size() const { return count; }
+    // Место под n слотов без перевыделений
+    void reserve(size_t n) { slots.reserve(n); }
+
+private:
+    struct Slot {
+        T value{};
+        uint32_t generation = 0;
+        bool occupied = false;
+    };
+    std::vector<Slot> slots;
+    std::vector<uint32_t> freeSlots;
+    size_t count = 0;
+};
@@ -0,0 +1,20 @@
+#include "SymbolTable.hpp"
+
+SymbolTable& SymbolTable::instance() {
+    // Не разрушается при выходе: имена нужны фигурам до самого конца
+    static SymbolTable* table = new SymbolTable();
+    return *table;
+}
+
+SymbolTable::SymbolTable() {
+    intern("");
+}
+
+Symbol SymbolTable::intern(std::string_view text) {
+    auto it = ids.find(text);
+    if (it != ids.end()) return it->second;
+    Symbol symbol = (Symbol)names.size();
+    names.emplace_back(text);
+    ids.emplace(names.back(), symbol);
+    return symbol;
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <deque>
+#include <unordered_map>
+#include <cstdint>
+
+using Symbol = uint32_t;
+
+// Таблица имён: каждая строка хранится один раз, фигуры держат её номер.
+// Строки не удаляются, поэтому string_view из name() действителен до конца программы.
+// Символ 0 — пустая строка.
+class SymbolTable {
+public:
+    static SymbolTable& instance();
+
+    Symbol intern(std::string_view text);
+    std::string_view name(Symbol symbol) const { return names[symbol]; }
+    size_t size() const { return names.size(); }
+
+private:
+    SymbolTable();
+
+    std::deque<std::string> names;   // deque не переносит строки при росте
+    std::unordered_map<std::string_view, Symbol> ids;
+};
@@ -0,0 +1,143 @@
+#pragma once
+#include <SFML/Graphics/Color.hpp>
+#include <SFML/System/Vector2.hpp>
+#include <charconv>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+#include <cstddef>
+
+// Числа текстового формата пишутся и читаются через to_chars/from_chars: локаль
+// не влияет, а float выводится кратчайшей записью, которая читается обратно тем же
+// числом. Разбор совместим с прежним чтением через operator>> для файлов,
+// записанных через operator<<
+
+// Дописывает текст в конец строки-буфера
+class TextWriter {
+public:
+    explicit TextWriter(std::string& out) : out(out) {}
+
+    TextWriter& operator<<(char c) {
+        out.push_back(c);
+        return *this;
+    }
+    TextWriter& operator<<(std::string_view s) {
+        out.append(s.data(), s.size());
+        return *this;
+    }
+    TextWriter& operator<<(const char* s) { return *this << std::string_view(s); }
+    TextWriter& operator<<(bool v) { return *this << (v ? '1' : '0'); }
+    template <typename T, typename = std::enable_if_t<std::is_arithmetic_v<T>>>
+    TextWriter& operator<<(T v) {
+        char text[32];
+        auto result = std::to_chars(text, text + sizeof text, v);
+        out.append(text, result.ptr);
+        return *this;
+    }
+
+    // Пары и цвета через пробел, как их писал operator<<
+    TextWriter& vec(sf::Vector2f v) { return *this << v.x << ' ' << v.y; }
+    TextWriter& color(sf::Color c) { return *this << int(c.r) << ' ' << int(c.g) << ' ' << int(c.b); }
+
+    size_t size() const { return out.size(); }
+    // Отправляет накопленное в поток и очищает буфер
+    template <typename Stream>
+    void flush(Stream& stream) {
+        stream.write(out.data(), out.size());
+        out.clear();
+    }
+
+private:
+    std::string& out;
+};
+
+// Читает текст из памяти. Как у std::istream: после первой ошибки чтение
+// прекращается, а состояние проверяется через operator bool. Непрочитанные
+// значения обнуляются, чтобы после ошибки в них не оставался мусор
+class TextReader {
+public:
+    TextReader(const char* begin, const char* end) : p(begin), end(end) {}
+
+    explicit operator bool() const { return !failed; }
+    const char* position() const { return p; }
+
+    // Слово до пробельного символа
+    TextReader& operator>>(std::string& word) {
+        if (!skipSpaces()) {
+            word.clear();
+            return *this;
+        }
+        const char* start = p;
+        while (p < end && !isSpace(*p)) ++p;
+        word.assign(start, p);
+        return *this;
+    }
+    // Строка целиком без пробелов по краям: так читаются имена, в которых бывают
+    // пробелы. Если от текущей строки остались одни пробелы, берётся следующая
+    TextReader& line(std::string& text) {
+        text.clear();
+        if (failed) return *this;
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) ++p;
+        if (p < end && *p == '\n') ++p;
+        if (p == end) {
+            failed = true;
+            return *this;
+        }
+        const char* start = p;
+        while (p < end && *p != '\n') ++p;
+        const char* last = p;
+        while (start < last && isSpace(*start)) ++start;
+        while (last > start && isSpace(last[-1])) --last;
+        text.assign(start, last);
+        return *this;
+    }
+    // 0 или 1
+    TextReader& operator>>(bool& v) {
+        unsigned value = 0;
+        *this >> value;
+        if (value > 1) failed = true;
+        v = !failed && value == 1;
+        return *this;
+    }
+    template <typename T, typename = std::enable_if_t<std::is_arithmetic_v<T>>>
+    TextReader& operator>>(T& v) {
+        if (!skipSpaces()) {
+            v = T();
+            return *this;
+        }
+        auto result = std::from_chars(p, end, v);
+        if (result.ec != std::errc()) {
+            failed = true;
+            v = T();
+            return *this;
+        }
+        p = result.ptr;
+        return *this;
+    }
+
+    // Пропускает пробелы и табуляции текущей строки; если дальше c — съедает его
+    bool consume(char c) {
+        while (p < end && (*p == ' ' || *p == '\t')) ++p;
+        if (failed || p == end || *p != c) return false;
+        ++p;
+        return true;
+    }
+
+    static bool isSpace(char c) {
+        return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+    }
+
+private:
+    // false и ошибка, если до конца данных одни пробелы
+    bool skipSpaces() {
+        if (failed) return false;
+        while (p < end && isSpace(*p)) ++p;
+        if (p == end) failed = true;
+        return !failed;
+    }
+
+    const char* p;
+    const char* end;
+    bool failed = false;
+};
@@ -5,6 +5,6 @@ class Trapezoid : public PolylineFigure {
 public:
     Trapezoid(float topBase, float bottomBase, float height,
               const sf::Color& color, const std::vector<float>& thicknesses);
-    std::string getTypeName() const { return "Trapezoid"; }
+    std::string_view getTypeName() const { return "Trapezoid"; }
 
 };
\ No newline at end of file
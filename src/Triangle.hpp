@@ -4,6 +4,6 @@
 class Triangle : public PolylineFigure {
 public:
     Triangle(float side, const sf::Color& color, const std::vector<float>& thicknesses);
-    std::string getTypeName() const { return "Triangle"; }
+    std::string_view getTypeName() const { return "Triangle"; }
 
 };
\ No newline at end of file
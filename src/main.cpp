@@ -6,6 +6,8 @@
 #include <iomanip>
 #include <cmath>
 #include <fstream>
+#include <optional>
+#include <future>
 
 #include "Editor.hpp"
 #include "Rectangle.hpp"
@@ -17,6 +19,8 @@
 #include "CompositeFigure.hpp"
 #include "FigureManager.hpp"
 #include "TextBox.hpp"
+#include "BatchOps.hpp"
+#include "SceneLoader.hpp"
 
 enum class Mode {
     THICKNESS,
@@ -45,6 +49,7 @@ enum class EditTarget {
 struct ShapeListItem {
     sf::FloatRect bounds;
     AbstractFigure* figure;
+    FigureHandle owner;     // фигура верхнего уровня, к которой относится строка
 };
 
 std::string colorToString(const sf::Color& c) {
@@ -109,8 +114,8 @@ std::string openLinuxDialog(bool saveMode, sf::RenderWindow& window) {
     std::string attachArg = " --attach=" + std::to_string(reinterpret_cast<uintptr_t>(handle)) + " --modal";
     
     std::string cmd = saveMode ?
-        "zenity --file-selection --save --confirm-overwrite --file-filter='*.txt'" + attachArg :
-        "zenity --file-selection --file-filter='*.txt'" + attachArg;
+        "zenity --file-selection --save --confirm-overwrite --file-filter='*.txt *.spb'" + attachArg :
+        "zenity --file-selection --file-filter='*.txt *.spb'" + attachArg;
     
     std::unique_ptr<FILE, decltype(&pclose)> pipe(popen(cmd.c_str(), "r"), pclose);
     if (!pipe) return "";
@@ -234,6 +239,16 @@ void drawEditWindow(sf::RenderWindow& window, AbstractFigure* fig, const sf::Fon
     window.draw(scaleText);
     currentY += lineSpacing;
 
+    // Rotation
+    sf::Text rotationText;
+    rotationText.setFont(font);
+    rotationText.setCharacterSize(24);
+    rotationText.setFillColor(sf::Color::White);
+    rotationText.setPosition(panelX + marginLeft, currentY);
+    rotationText.setString("Rotation: " + std::to_string((int)fig->getRotation()));
+    window.draw(rotationText);
+    currentY += lineSpacing;
+
     fieldY = currentY;
 
     // Pivot X
@@ -307,7 +322,7 @@ void drawEditWindow(sf::RenderWindow& window, AbstractFigure* fig, const sf::Fon
     window.draw(fillColorText);
     currentY += lineSpacing;
 
-    if (auto* poly = dynamic_cast<PolylineFigure*>(fig)) {
+    if (auto* poly = figureCast<PolylineFigure>(fig)) {
         sf::Text thickTitle;
         thickTitle.setFont(font);
         thickTitle.setCharacterSize(24);
@@ -364,7 +379,7 @@ void drawEditWindow(sf::RenderWindow& window, AbstractFigure* fig, const sf::Fon
         }
         currentY += 15;
     }
-    else if (auto* circle = dynamic_cast<Circle*>(fig)) {
+    else if (auto* circle = figureCast<Circle>(fig)) {
         sf::Text outlineTitle;
         outlineTitle.setFont(font);
         outlineTitle.setCharacterSize(24);
@@ -518,6 +533,8 @@ int main() {
     sf::RenderWindow window(sf::VideoMode::getDesktopMode(), "Simple Paint", sf::Style::Fullscreen);
     window.setFramerateLimit(60);
     Editor editor;
+    // Фоновое сохранение по снимку сцены; редактирование при этом не останавливается
+    std::future<void> pendingSave;
 
     float rectWidth = 150, rectHeight = 100;
     float triSide = 120;
@@ -592,6 +609,8 @@ int main() {
     std::string currentShapeName = "Rectangle";
 
     std::vector<AbstractFigure*> multiSelected;
+    sf::VertexArray selectionFrames;
+    bool selectionFramesDirty = true;
 
     bool creatingPolyline = false;
     bool waitingForPolylineName = false;
@@ -637,6 +656,34 @@ int main() {
     sf::Text loadBtnText("LOAD", font, 18);
     loadBtnText.setPosition(145, 14);
 
+    // Ход фоновой загрузки и кнопка её отмены
+    sf::RectangleShape progressBg({200, 30});
+    progressBg.setFillColor(sf::Color(30, 30, 30));
+    progressBg.setOutlineColor(sf::Color::White);
+    progressBg.setOutlineThickness(1);
+    progressBg.setPosition(230, 10);
+
+    sf::RectangleShape progressBar({0, 30});
+    progressBar.setFillColor(sf::Color(50, 150, 50));
+    progressBar.setPosition(230, 10);
+
+    sf::Text progressText("", font, 18);
+    progressText.setPosition(240, 14);
+
+    sf::RectangleShape cancelBtnRect({100, 30});
+    cancelBtnRect.setFillColor(sf::Color(150, 50, 50));
+    cancelBtnRect.setPosition(440, 10);
+
+    sf::Text cancelBtnText("CANCEL", font, 18);
+    cancelBtnText.setPosition(452, 14);
+
+    std::unique_ptr<SceneLoader> loader;
+    auto startLoading = [&](const std::string& path) {
+        loader.reset();
+        multiSelected.clear();
+        loader = std::make_unique<SceneLoader>(editor, path);
+    };
+
 
     sf::Text helpText;
     helpText.setFont(font);
@@ -654,12 +701,19 @@ int main() {
             << "L: fill/unfill selected figure\n"
             << "T: inc thickness, Shift+T: dec\n"
             << "Y: next side/vertex\n"
+            << "Ctrl+Click (VERTEX mode): split edge\n"
             << "Z: group selected\n"
             << "U: ungroup selected composite\n"
+            << "I: freeze/thaw selected group\n"
+            << "O: select overlapping, Shift+O: all overlaps\n"
+            << "PgUp/PgDn: raise/lower, Shift: to front/back\n"
+            << "Q/E: rotate around pivot, Shift: by 1 degree\n"
+            << "Multi-select: arrows move, wheel scales, L/R/G/B/T apply to all\n"
             << "N: new polyline\n"
             << "P: when Polyline with parameters\n"
             << "Enter (when creating): finish polyline\n"
             << "Delete: remove selected\n"
+            << "Ctrl+Z: undo, Ctrl+Y / Ctrl+Shift+Z: redo\n"
             << "Mouse wheel: scale\n"
             << "F5: save scene to scene.txt\n"
             << "F9: load scene from scene.txt\n"
@@ -799,6 +853,7 @@ int main() {
         editor.addFigure(tri2);
     };
     createInitialShapes();
+    editor.getHistory().clear();
 
     sf::FloatRect shapeListBounds;
     std::vector<ShapeListItem> shapeListItems;
@@ -815,6 +870,8 @@ int main() {
     while (window.isOpen()) {
         sf::Event event;
         while (window.pollEvent(event)) {
+            // Набор и его фигуры меняют только события; движение мыши — лишь при перетаскивании
+            if (event.type != sf::Event::MouseMoved || editor.isChanging()) selectionFramesDirty = true;
             if (fileDialogActive) {
                 // Игнорируем все события, пока активен внешний диалог
                 if (event.type == sf::Event::Closed) window.close();
@@ -833,6 +890,21 @@ int main() {
                 window.close();
             }
 
+            // Ctrl+Z – отмена, Ctrl+Y и Ctrl+Shift+Z – повтор
+            if (event.type == sf::Event::KeyPressed && event.key.control &&
+                (event.key.code == sf::Keyboard::Z || event.key.code == sf::Keyboard::Y)) {
+                bool redo = event.key.code == sf::Keyboard::Y || event.key.shift;
+                if (redo ? editor.redo() : editor.undo()) multiSelected.clear();
+                continue;
+            }
+
+            // Всё, что меняет одно событие, откатывается одним Ctrl+Z. Фигуры, которые
+            // обработчики меняют в обход редактора, запоминаются через touch прямо перед правкой
+            std::optional<Editor::ChangeScope> scope;
+            if (event.type == sf::Event::KeyPressed || event.type == sf::Event::MouseButtonPressed ||
+                event.type == sf::Event::MouseWheelScrolled)
+                scope.emplace(editor);
+
             if (event.type == sf::Event::MouseButtonPressed && event.mouseButton.button == sf::Mouse::Left) {
                 sf::Vector2i mousePos(event.mouseButton.x, event.mouseButton.y);
                 sf::Vector2f worldPos = window.mapPixelToCoords(mousePos);
@@ -851,12 +923,15 @@ int main() {
                 if (btnLoad.getGlobalBounds().contains(worldPos)) {
                     fileDialogActive = true;
                     std::string path = openLinuxDialog(false, window);
-                    if (!path.empty()) editor.loadFromFile(path);
+                    if (!path.empty()) startLoading(path);
                     fileDialogActive = false;
                 }
+                else if (loader && cancelBtnRect.getGlobalBounds().contains(worldPos)) {
+                    loader->cancel();
+                }
                 else if (shapeListBounds.contains(worldPos)) {
                     for (const auto& item : shapeListItems) {
-                        if (item.bounds.contains(worldPos) && item.figure) {
+                        if (item.bounds.contains(worldPos) && item.figure && editor.getFigure(item.owner)) {
                             multiSelected.clear();
                             editor.setSelected(item.figure);
                             break;
@@ -882,20 +957,20 @@ int main() {
                                 case EditTarget::POLYLINE_ANGLE: initialValue = currentDrawAngle; break;
                                 case EditTarget::POLYLINE_LENGTH: initialValue = currentDrawLength; break;
                                 case EditTarget::THICKNESS:
-                                    if (auto* poly = dynamic_cast<PolylineFigure*>(sel)) {
+                                    if (auto* poly = figureCast<PolylineFigure>(sel)) {
                                         initialValue = poly->getThicknesses()[field.index];
                                         editIndex = field.index;
                                     }
                                     break;
                                 case EditTarget::SIDE_COLOR:
-                                    if (auto* poly = dynamic_cast<PolylineFigure*>(sel)) {
+                                    if (auto* poly = figureCast<PolylineFigure>(sel)) {
                                         initialColor = poly->getSideColors()[field.index];
                                         isColorTarget = true;
                                         editIndex = field.index;
                                     }
                                     break;
                                 case EditTarget::CIRCLE_THICKNESS:
-                                    if (auto* circle = dynamic_cast<Circle*>(sel)) {
+                                    if (auto* circle = figureCast<Circle>(sel)) {
                                         currentEditTarget = field.target;
                                         inputBox.setPosition(field.bounds.left, field.bounds.top);
                                         inputBox.setSize(field.bounds.width, field.bounds.height);
@@ -921,6 +996,7 @@ int main() {
                     if (creatingPolyline) {
                         AbstractFigure* sel = editor.getSelected();
                         if (sel) {
+                            editor.touch(sel);
                             sel->addVertex(worldPos);
                             if (sel->getVertexCount() >= 2) {
                                 sf::Vector2f v1 = sel->getLocalVertex(sel->getVertexCount() - 2);
@@ -929,6 +1005,17 @@ int main() {
                             }
                         }
                     } 
+                    else if (currentMode == Mode::VERTEX &&
+                             (sf::Keyboard::isKeyPressed(sf::Keyboard::LControl) ||
+                              sf::Keyboard::isKeyPressed(sf::Keyboard::RControl))) {
+                        // Ctrl+клик – вставить вершину на ближайшей стороне
+                        SegmentHit hit = editor.splitSegmentAt(worldPos, 10.f);
+                        if (hit.figure) {
+                            multiSelected.clear();
+                            editor.setSelected(hit.figure);
+                            selectedIndex = hit.side + 1;
+                        }
+                    }
                     else {
                         AbstractFigure* clickedFigure = editor.findFigureAt(worldPos);
                         bool shiftPressed = sf::Keyboard::isKeyPressed(sf::Keyboard::LShift) ||
@@ -952,7 +1039,7 @@ int main() {
                                     nameInputBox.setLabel("Rename figure:");
                                     nameInputBox.activate(0); 
                                     nameInputBox.setTextMode(true);
-                                    nameInputBox.setString(clickedFigure->getTypeName());
+                                    nameInputBox.setString(std::string(clickedFigure->getTypeName()));
                                     currentRenamingFigure = clickedFigure;
                                     nameInputActive = true;
                                 } else {
@@ -972,7 +1059,11 @@ int main() {
                 editor.handleEvent(event, window);
             }
 
-            if (event.type == sf::Event::MouseWheelScrolled && editor.getSelected()) {
+            if (event.type == sf::Event::MouseWheelScrolled && !multiSelected.empty()) {
+                editor.touch(multiSelected);
+                BatchOps::scale(multiSelected, 1.0f + event.mouseWheelScroll.delta * 0.1f);
+            }
+            else if (event.type == sf::Event::MouseWheelScrolled && editor.getSelected()) {
                 float delta = event.mouseWheelScroll.delta;
                 editor.handleScale(delta);
             }
@@ -998,9 +1089,18 @@ int main() {
                         case Mode::VERTEX: currentMode = Mode::THICKNESS; break;
                     }
                 }
-                if (event.key.code == sf::Keyboard::L) {
+                if (event.key.code == sf::Keyboard::L && !multiSelected.empty()) {
+                    // Весь набор получает состояние, противоположное первой фигуре
+                    AbstractFigure* ref = multiSelected.front();
+                    sf::Color c = ref->getFillColor();
+                    if (c == sf::Color::Transparent || c == sf::Color{0,0,0,0}) c = sf::Color::Blue;
+                    editor.touch(multiSelected);
+                    BatchOps::setFill(multiSelected, c, !ref->isFilled());
+                }
+                else if (event.key.code == sf::Keyboard::L) {
                     AbstractFigure* selected = editor.getSelected();
                     if (selected) {
+                        editor.touch(selected);
                         bool currentState = selected->isFilled();
                         selected->setFilled(!currentState);
                         if (selected->getFillColor() == sf::Color::Transparent || selected->getFillColor() == sf::Color{0,0,0,0}) {
@@ -1010,9 +1110,32 @@ int main() {
                     }
                 }
 
+                if ((event.key.code == sf::Keyboard::R || event.key.code == sf::Keyboard::G || event.key.code == sf::Keyboard::B) &&
+                    !multiSelected.empty() && (currentMode == Mode::FILL || currentMode == Mode::COLOR)) {
+                    // Сдвиг считается от первой фигуры набора и применяется ко всем сразу
+                    AbstractFigure* ref = multiSelected.front();
+                    int step = event.key.shift ? -10 : 10;
+                    sf::Color c = ref->getFillColor();
+                    if (currentMode == Mode::COLOR) {
+                        if (auto* poly = figureCast<PolylineFigure>(ref)) c = poly->getSideColor(std::max(selectedIndex, 0));
+                        else if (auto* circle = figureCast<Circle>(ref)) c = circle->getOutlineColor();
+                    }
+                    switch (event.key.code) {
+                        case sf::Keyboard::R: c.r = std::clamp((int)c.r + step, 0, 255); break;
+                        case sf::Keyboard::G: c.g = std::clamp((int)c.g + step, 0, 255); break;
+                        case sf::Keyboard::B: c.b = std::clamp((int)c.b + step, 0, 255); break;
+                        default: break;
+                    }
+                    editor.touch(multiSelected);
+                    if (currentMode == Mode::FILL) BatchOps::setFill(multiSelected, c, ref->isFilled());
+                    else BatchOps::setSideColor(multiSelected, c);
+                    continue;
+                }
+
                 if (event.key.code == sf::Keyboard::R || event.key.code == sf::Keyboard::G || event.key.code == sf::Keyboard::B) {
                     AbstractFigure* sel = editor.getSelected();
                     if (!sel) continue;
+                    editor.touch(sel);
 
                     int step = event.key.shift ? -10 : 10;
 
@@ -1027,7 +1150,7 @@ int main() {
                         sel->setFillColor(c);
                     }
                     else if (currentMode == Mode::COLOR) {
-                        if (auto* poly = dynamic_cast<PolylineFigure*>(sel)) {
+                        if (auto* poly = figureCast<PolylineFigure>(sel)) {
                             if (selectedIndex < 0 || selectedIndex >= (int)poly->getSideColors().size()) continue;
                             sf::Color c = poly->getSideColor(selectedIndex);
                             switch (event.key.code) {
@@ -1038,7 +1161,7 @@ int main() {
                             }
                             poly->setSideColor(selectedIndex, c);
                         }
-                        else if (auto* circle = dynamic_cast<Circle*>(sel)) {
+                        else if (auto* circle = figureCast<Circle>(sel)) {
                             sf::Color c = circle->getOutlineColor();
                             switch (event.key.code) {
                                 case sf::Keyboard::R: c.r = std::clamp((int)c.r + step, 0, 255); break;
@@ -1054,6 +1177,7 @@ int main() {
                 if (event.key.code == sf::Keyboard::P && creatingPolyline) {
                     AbstractFigure* sel = editor.getSelected();
                     if (sel) {
+                        editor.touch(sel);
                         sf::Vector2f lastVert;
                         if (sel->getVertexCount() == 0) {
                             lastVert = sf::Vector2f(window.getSize().x / 2.f, window.getSize().y / 2.f);
@@ -1071,7 +1195,17 @@ int main() {
 
                 if (event.key.code == sf::Keyboard::Up || event.key.code == sf::Keyboard::Down ||
                     event.key.code == sf::Keyboard::Left || event.key.code == sf::Keyboard::Right) {
-                    if (editor.getSelected()) {
+                    if (!multiSelected.empty()) {
+                        float step = event.key.shift ? 10.f : 1.f;
+                        sf::Vector2f offset;
+                        if (event.key.code == sf::Keyboard::Up) offset.y = -step;
+                        else if (event.key.code == sf::Keyboard::Down) offset.y = step;
+                        else if (event.key.code == sf::Keyboard::Left) offset.x = -step;
+                        else offset.x = step;
+                        editor.touch(multiSelected);
+                        BatchOps::translate(multiSelected, offset);
+                    }
+                    else if (editor.getSelected()) {
                         AbstractFigure* sel = editor.getSelected();
                         int dx = 0, dy = 0;
                         if (event.key.code == sf::Keyboard::Up) dy = -1;
@@ -1079,6 +1213,7 @@ int main() {
                         else if (event.key.code == sf::Keyboard::Left) dx = -1;
                         else if (event.key.code == sf::Keyboard::Right) dx = 1;
 
+                        editor.touch(sel);
                         if (currentMode == Mode::PIVOT) {
                             sel->setLocalPivot(sel->getLocalPivot() + sf::Vector2f(dx, dy));
                         }
@@ -1115,7 +1250,7 @@ int main() {
                             auto ptr = editor.extractFigure(toGroup[i]);
                             if (ptr) {
                                 sf::Vector2f localOffset = globalPositions[i] - centerPos;
-                                composite->addFigure(std::move(ptr), localOffset);
+                                editor.addToGroup(composite, std::move(ptr), localOffset);
                             }
                         }
                         editor.addFigure(composite);
@@ -1129,8 +1264,8 @@ int main() {
                     AbstractFigure* sel = editor.getSelected();
                     if (sel) {
                         // 1. Целая группа
-                        if (auto* composite = dynamic_cast<CompositeFigure*>(sel)) {
-                            sf::Vector2f compPos = composite->getPosition();
+                        if (auto* composite = figureCast<CompositeFigure>(sel)) {
+                            sf::Vector2f compPos = editor.getDrawPosition(composite);
                             size_t n = composite->getChildCount();
                             std::vector<std::unique_ptr<AbstractFigure>> children;
                             std::vector<sf::Vector2f> offsets;
@@ -1138,43 +1273,32 @@ int main() {
                                 offsets.push_back(composite->getChildOffset(i));
                             }
                             for (size_t i = 0; i < n; ++i) {
-                                auto child = composite->extractFigure(0);
+                                auto child = editor.extractFromGroup(composite->getChild(0));
                                 if (child) children.push_back(std::move(child));
                             }
                             editor.removeFigure(composite);
+                            FigureHandle last;
                             for (size_t i = 0; i < children.size(); ++i) {
                                 children[i]->setPosition(compPos + offsets[i]);
-                                editor.addFigure(children[i].release());
+                                last = editor.addFigure(children[i].release());
                             }
-                            editor.setSelected(editor.getFigure(editor.getFigureCount() - 1));
+                            editor.setSelected(editor.getFigure(last));
                         }
                         // 2. Отдельный элемент в группе
                         else {
-                            CompositeFigure* parent = nullptr;
-                            size_t index = 0;
-                            int total = editor.getFigureCount();
-                            for (int i = 0; i < total; ++i) {
-                                AbstractFigure* f = editor.getFigure(i);
-                                if (auto* comp = dynamic_cast<CompositeFigure*>(f)) {
-                                    for (size_t j = 0; j < comp->getChildCount(); ++j) {
-                                        if (comp->getChild(j) == sel) {
-                                            parent = comp;
-                                            index = j;
-                                            break;
-                                        }
-                                    }
-                                    if (parent) break;
-                                }
-                            }
+                            CompositeFigure* parent = editor.findParent(sel);
                             if (parent) {
-                                sf::Vector2f offset = parent->getChildOffset(index);
-                                auto child = parent->extractFigure(index);
+                                sf::Vector2f pos = editor.getDrawPosition(sel);
+                                auto child = editor.extractFromGroup(sel);
                                 if (child) {
-                                    child->setPosition(parent->getPosition() + offset);
+                                    child->setPosition(pos);
                                     editor.addFigure(child.release());
-                                    if (parent->getChildCount() == 1) {
-                                        auto last = parent->extractFigure(0);
-                                        last->setPosition(parent->getPosition() + parent->getChildOffset(0));
+                                    // Группа верхнего уровня из одного элемента распускается
+                                    if (parent->getChildCount() == 1 && !editor.getHandle(parent).isNull()) {
+                                        AbstractFigure* lastChild = parent->getChild(0);
+                                        sf::Vector2f lastPos = editor.getDrawPosition(lastChild);
+                                        auto last = editor.extractFromGroup(lastChild);
+                                        last->setPosition(lastPos);
                                         editor.addFigure(last.release());
                                         editor.removeFigure(parent);
                                     }
@@ -1185,6 +1309,53 @@ int main() {
                     }
                 }
 
+                // O – фигуры, пересекающиеся с выбранной; Shift+O – все пересечения на сцене
+                if (event.key.code == sf::Keyboard::O) {
+                    multiSelected.clear();
+                    if (event.key.shift) {
+                        auto pairs = editor.findOverlappingPairs();
+                        for (const auto& p : pairs) {
+                            multiSelected.push_back(p.first);
+                            multiSelected.push_back(p.second);
+                        }
+                        std::sort(multiSelected.begin(), multiSelected.end());
+                        multiSelected.erase(std::unique(multiSelected.begin(), multiSelected.end()), multiSelected.end());
+                    } else if (AbstractFigure* sel = editor.getSelected()) {
+                        multiSelected = editor.findOverlapping(sel);
+                    }
+                }
+
+                // PageUp/PageDown – на слой выше/ниже, с Shift – на передний/задний план
+                if (event.key.code == sf::Keyboard::PageUp || event.key.code == sf::Keyboard::PageDown) {
+                    std::vector<AbstractFigure*> targets = multiSelected;
+                    if (targets.empty() && editor.getSelected()) targets.push_back(editor.getSelected());
+                    bool up = event.key.code == sf::Keyboard::PageUp;
+                    if (event.key.shift) {
+                        if (up) editor.bringToFront(targets);
+                        else editor.sendToBack(targets);
+                    } else {
+                        if (up) editor.raise(targets);
+                        else editor.lower(targets);
+                    }
+                }
+
+                // I – заморозить выбранную группу в один массив треугольников или разморозить
+                if (event.key.code == sf::Keyboard::I) {
+                    if (auto* composite = figureCast<CompositeFigure>(editor.getSelected())) {
+                        if (composite->isFrozen()) composite->thaw();
+                        else composite->freeze();
+                    }
+                }
+
+                // Q/E – поворот на 15° против/по часовой стрелке вокруг пивота, с Shift – на 1°
+                if (event.key.code == sf::Keyboard::Q || event.key.code == sf::Keyboard::E) {
+                    std::vector<AbstractFigure*> targets = multiSelected;
+                    if (targets.empty() && editor.getSelected()) targets.push_back(editor.getSelected());
+                    float step = event.key.shift ? 1.f : 15.f;
+                    editor.touch(targets);
+                    BatchOps::rotate(targets, event.key.code == sf::Keyboard::Q ? -step : step);
+                }
+
                 if (event.key.code == sf::Keyboard::N && !creatingPolyline && !waitingForPolylineName) {
                     creatingPolyline = true;
                     accumulatedHeading = 0.0f;
@@ -1197,13 +1368,26 @@ int main() {
                     nameInputActive = false;
                 }
 
-                if (event.key.code == sf::Keyboard::T) {
+                if (event.key.code == sf::Keyboard::T && !multiSelected.empty()) {
+                    AbstractFigure* ref = multiSelected.front();
+                    float thick = 2.0f;
+                    if (auto* poly = figureCast<PolylineFigure>(ref)) {
+                        if (!poly->getThicknesses().empty())
+                            thick = poly->getThicknesses()[std::min<size_t>(std::max(selectedIndex, 0), poly->getThicknesses().size() - 1)];
+                    }
+                    else if (auto* circle = figureCast<Circle>(ref)) thick = circle->getOutlineThickness();
+                    thick = event.key.shift ? std::max(1.0f, thick - 1.0f) : thick + 1.0f;
+                    editor.touch(multiSelected);
+                    BatchOps::setThickness(multiSelected, thick);
+                }
+                else if (event.key.code == sf::Keyboard::T) {
                     if (auto* sel = editor.getSelected()) {
-                        if (auto* poly = dynamic_cast<PolylineFigure*>(sel)) {
+                        if (auto* poly = figureCast<PolylineFigure>(sel)) {
                             if (selectedIndex < (int)poly->getThicknesses().size()) {
                                 float newThick = poly->getThicknesses()[selectedIndex];
                                 if (event.key.shift) newThick = std::max(1.0f, newThick - 1.0f);
                                 else newThick += 1.0f;
+                                editor.touch(poly);
                                 poly->setThickness(selectedIndex, newThick);
                             }
                         }
@@ -1222,7 +1406,7 @@ int main() {
                     if (editor.getSelected()) {
                         if (currentMode == Mode::VERTEX) {
                             maxIndex = editor.getSelected()->getVertexCount();
-                        } else if (auto* poly = dynamic_cast<PolylineFigure*>(editor.getSelected())) {
+                        } else if (auto* poly = figureCast<PolylineFigure>(editor.getSelected())) {
                             maxIndex = poly->getThicknesses().size();
                         }
                     } else {
@@ -1250,6 +1434,7 @@ int main() {
                 if (event.key.code == sf::Keyboard::Enter && creatingPolyline) {
                     AbstractFigure* sel = editor.getSelected();
                     if (sel && sel->getVertexCount() > 0) {
+                        editor.touch(sel);
                         sf::Vector2f sum(0,0);
                         for (size_t i = 0; i < sel->getVertexCount(); ++i)
                             sum += sel->getLocalVertex(i);
@@ -1274,10 +1459,15 @@ int main() {
                 }
 
                 if (event.key.code == sf::Keyboard::F5) {
-                    editor.saveToFile("scene.txt");
+                    if (pendingSave.valid()) pendingSave.wait();
+                    pendingSave = std::async(std::launch::async, [scene = editor.snapshot()] {
+                        std::ofstream out("scene.txt");
+                        if (out) scene.save(out);
+                    });
                 }
                 if (event.key.code == sf::Keyboard::F9) {
-                    editor.loadFromFile("scene.txt");
+                    if (pendingSave.valid()) pendingSave.wait();
+                    startLoading("scene.txt");
                 }
             }
         }
@@ -1287,8 +1477,7 @@ int main() {
             if (userEnteredName.empty()) userEnteredName = "Polyline";
             auto newPoly = std::make_unique<PolylineFigure>(currentOutlineColor, std::vector<float>{2});
             newPoly->setCustomName(userEnteredName);
-            editor.addFigure(newPoly.release());
-            editor.setSelected(editor.getFigure(editor.getFigureCount() - 1));
+            editor.setSelected(editor.getFigure(editor.addFigure(newPoly.release())));
             creatingPolyline = true;
             waitingForPolylineName = false;
             nameInputActive = false;
@@ -1297,6 +1486,7 @@ int main() {
         if (nameInputActive && !nameInputBox.isActive()) {
             if (currentRenamingFigure != nullptr) {
                 if (!nameInputBox.getString().empty()) {
+                    Editor::ChangeScope scope(editor, {currentRenamingFigure});
                     currentRenamingFigure->setCustomName(nameInputBox.getString());
                 }
                 currentRenamingFigure = nullptr;
@@ -1304,8 +1494,7 @@ int main() {
             else if (waitingForPolylineName) {
                 pendingPolylineName = nameInputBox.getString();
                 auto newPoly = std::make_unique<PolylineFigure>(currentOutlineColor, std::vector<float>{2});
-                editor.addFigure(newPoly.release());
-                editor.setSelected(editor.getFigure(editor.getFigureCount() - 1));
+                editor.setSelected(editor.getFigure(editor.addFigure(newPoly.release())));
                 creatingPolyline = true;
                 waitingForPolylineName = false;
             }
@@ -1315,6 +1504,7 @@ int main() {
         if (!inputBox.isActive() && currentEditTarget != EditTarget::NONE) {
             float val = inputBox.getValue();
             if (auto* sel = editor.getSelected()) {
+                Editor::ChangeScope scope(editor, {sel});
                 switch (currentEditTarget) {
                     case EditTarget::GLOBAL_X: {
                         sf::Vector2f pos = sel->getPosition();
@@ -1355,14 +1545,14 @@ int main() {
                     case EditTarget::POLYLINE_ANGLE: currentDrawAngle = val; break;
                     case EditTarget::POLYLINE_LENGTH: currentDrawLength = val; break;
                     case EditTarget::THICKNESS: {
-                        if (auto* poly = dynamic_cast<PolylineFigure*>(sel)) {
+                        if (auto* poly = figureCast<PolylineFigure>(sel)) {
                             int intVal = std::round(val);
                             poly->setThickness(editIndex, intVal);
                         }
                         break;
                     }
                     case EditTarget::CIRCLE_THICKNESS:
-                        if (auto* circle = dynamic_cast<Circle*>(sel)) {
+                        if (auto* circle = figureCast<Circle>(sel)) {
                             circle->setOutlineThickness(inputBox.getValue());
                         }
                         break;
@@ -1372,18 +1562,22 @@ int main() {
             currentEditTarget = EditTarget::NONE;
         }
 
+        // Загруженная часть сцены видна и редактируется сразу
+        if (loader) {
+            loader->update(sf::milliseconds(10));
+            if (loader->isDone()) loader.reset();
+        }
+
         window.clear(sf::Color(50,50,50));
         editor.draw(window);
 
-        for (auto* fig : multiSelected) {
-            sf::FloatRect bounds = fig->getBoundingBox();
-            sf::RectangleShape rect({bounds.width, bounds.height});
-            rect.setPosition(bounds.left, bounds.top);
-            rect.setFillColor(sf::Color::Transparent);
-            rect.setOutlineColor(sf::Color::Red);
-            rect.setOutlineThickness(2);
-            window.draw(rect);
+        // Рамки набора и общая рамка — одним вызовом отрисовки; пересобираются
+        // только после событий, которые могли их сдвинуть
+        if (selectionFramesDirty) {
+            BatchOps::buildFrames(multiSelected, selectionFrames);
+            selectionFramesDirty = false;
         }
+        window.draw(selectionFrames);
 
         if (showHelp) window.draw(helpText);
         if (creatingPolyline) {
@@ -1419,7 +1613,7 @@ int main() {
         float itemY = listY + 30;
         int totalFigures = editor.getFigureCount();
 
-        auto addListItem = [&](AbstractFigure* fig, int depth, const std::string& label) {
+        auto addListItem = [&](AbstractFigure* fig, FigureHandle owner, int depth, const std::string& label) {
             std::string indent(depth * 4, ' ');
             sf::Text item;
             item.setFont(font);
@@ -1434,6 +1628,7 @@ int main() {
             ShapeListItem listItem;
             listItem.bounds = bounds;
             listItem.figure = fig;
+            listItem.owner = owner;
             shapeListItems.push_back(listItem);
             itemY += 22;
         };
@@ -1441,11 +1636,13 @@ int main() {
         for (int i = 0; i < totalFigures; ++i) {
             AbstractFigure* fig = editor.getFigure(i);
             if (!fig) continue;
-            std::string label = fig->getCustomName() + " #" + std::to_string(i+1);
-            addListItem(fig, 0, label);
-            if (auto* comp = dynamic_cast<CompositeFigure*>(fig)) {
+            FigureHandle handle = editor.getHandle(fig);
+            std::string label(fig->getCustomName());
+            label += " #" + std::to_string(i+1);
+            addListItem(fig, handle, 0, label);
+            if (auto* comp = figureCast<CompositeFigure>(fig)) {
                 for (size_t j = 0; j < comp->getChildCount(); ++j) {
-                    addListItem(comp->getChild(j), 1, "-> " + comp->getChild(j)->getTypeName());
+                    addListItem(comp->getChild(j), handle, 1, "-> " + std::string(comp->getChild(j)->getTypeName()));
                 }
             }
         }
@@ -1454,6 +1651,16 @@ int main() {
         window.draw(saveBtnText);
         window.draw(loadBtnRect);
         window.draw(loadBtnText);
+        if (loader) {
+            float progress = loader->getProgress();
+            progressBar.setSize({progressBg.getSize().x * progress, progressBg.getSize().y});
+            progressText.setString("Loading " + std::to_string(int(progress * 100)) + "%");
+            window.draw(progressBg);
+            window.draw(progressBar);
+            window.draw(progressText);
+            window.draw(cancelBtnRect);
+            window.draw(cancelBtnText);
+        }
         inputBox.update();
         inputBox.draw(window);
         nameInputBox.update();